@@ -9,6 +9,53 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <unordered_map>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <thread>
+#include <random>
+#include <functional>
+#include <memory>
+#include <ctime>
+#include <cfloat>
+#include <limits>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cctype>
+#include <array>
+#include <csignal>
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// Offscreen contexts for --headless: build with -DHEADLESS_EGL (link -lEGL) for an EGL
+// surfaceless context, or -DHEADLESS_OSMESA (link -lOSMesa) for OSMesa
+#if defined(HEADLESS_EGL)
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#elif defined(HEADLESS_OSMESA)
+#include <GL/osmesa.h>
+#endif
 
 // Shader sources
 const char* vertexShaderSource = R"(
@@ -28,6 +75,24 @@ const char* vertexShaderSource = R"(
    }
 )";
 
+// Scene mode: the model matrix comes from the per-instance buffer (locations 2-5)
+const char* instancedVertexShaderSource = R"(
+   #version 330 core
+   layout (location = 0) in vec3 aPos;
+   layout (location = 1) in vec3 aColor;
+   layout (location = 2) in mat4 aModel;
+   
+   uniform mat4 view;
+   uniform mat4 projection;
+   
+   out vec3 ourColor;
+   
+   void main() {
+       gl_Position = projection * view * aModel * vec4(aPos, 1.0);
+       ourColor = aColor;
+   }
+)";
+
 const char* fragmentShaderSource = R"(
    #version 330 core
    in vec3 ourColor;
@@ -39,11 +104,543 @@ const char* fragmentShaderSource = R"(
 )";
 
 
+// Decides when the main loop draws a frame. Input, resizes and UI changes mark the
+// view dirty and animated views ask for frames continuously; either way frames are
+// capped at maxFps. With nothing dirty or animating the loop blocks in
+// glfwWaitEventsTimeout instead of redrawing, so an idle viewer uses next to no CPU.
+class FramePacer {
+public:
+    double maxFps = 60.0;       // 0 = no cap beyond vsync
+    double idleTimeout = 0.5;   // seconds between wakeups while idle
+    bool continuous = false;    // redraw every iteration regardless of dirty state
+
+    // ImGui settles hover and active states one frame after the event, so an event
+    // buys two frames
+    void markDirty(int frames = 2) { dirtyFrames = std::max(dirtyFrames, frames); }
+
+    void markResized() {
+        resized = true;
+        markDirty();
+    }
+
+    // Stamps user input, for measuring how long it takes to show up on screen
+    void markInput() {
+        lastInputTime = glfwGetTime();
+        markDirty();
+    }
+
+    double lastInput() const { return lastInputTime; }
+
+    bool takeResized() {
+        bool wasResized = resized;
+        resized = false;
+        return wasResized;
+    }
+
+    // Blocks until the next frame is due and returns the seconds since the previous
+    // one, clamped so the first frame after an idle stretch does not jump animations
+    float waitForFrame(GLFWwindow* window, bool animating) {
+        glfwPollEvents();
+        while (!continuous && !animating && dirtyFrames == 0 && !glfwWindowShouldClose(window)) {
+            glfwWaitEventsTimeout(idleTimeout);
+        }
+
+        if (maxFps > 0.0) {
+            double due = lastFrameTime + 1.0 / maxFps;
+            for (double now = glfwGetTime(); now < due && !glfwWindowShouldClose(window); now = glfwGetTime()) {
+                glfwWaitEventsTimeout(due - now);
+            }
+        }
+
+        double now = glfwGetTime();
+        float deltaTime = static_cast<float>(std::min(now - lastFrameTime, 0.1));
+        lastFrameTime = now;
+        if (dirtyFrames > 0) --dirtyFrames;
+        ++framesDrawn;
+        return deltaTime;
+    }
+
+    size_t frames() const { return framesDrawn; }
+
+private:
+    int dirtyFrames = 2;
+    bool resized = false;
+    double lastFrameTime = 0.0;
+    double lastInputTime = 0.0;
+    size_t framesDrawn = 0;
+};
+
 // Callback function for window resize
 void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
     glViewport(0, 0, width, height);
+    if (FramePacer* pacer = static_cast<FramePacer*>(glfwGetWindowUserPointer(window))) {
+        pacer->markResized();
+    }
+}
+
+// Any input or expose event makes the next frames dirty. Installed before ImGui, which
+// chains to these from its own callbacks.
+void markWindowDirty(GLFWwindow* window) {
+    if (FramePacer* pacer = static_cast<FramePacer*>(glfwGetWindowUserPointer(window))) {
+        pacer->markDirty();
+    }
+}
+
+void markWindowInput(GLFWwindow* window) {
+    if (FramePacer* pacer = static_cast<FramePacer*>(glfwGetWindowUserPointer(window))) {
+        pacer->markInput();
+    }
 }
 
+void installDirtyCallbacks(GLFWwindow* window, FramePacer& pacer) {
+    glfwSetWindowUserPointer(window, &pacer);
+    glfwSetWindowRefreshCallback(window, [](GLFWwindow* w) { markWindowDirty(w); });
+    glfwSetCursorPosCallback(window, [](GLFWwindow* w, double, double) { markWindowInput(w); });
+    glfwSetMouseButtonCallback(window, [](GLFWwindow* w, int, int, int) { markWindowInput(w); });
+    glfwSetScrollCallback(window, [](GLFWwindow* w, double, double) { markWindowInput(w); });
+    glfwSetKeyCallback(window, [](GLFWwindow* w, int, int, int, int) { markWindowInput(w); });
+}
+
+// Per-frame CPU and GPU profiler. Scopes time themselves on the CPU and, for top-level
+// GPU scopes, with GL_TIME_ELAPSED queries kept in a ring of queryFrames frames: a
+// frame's results are read queryFrames frames later and only if already available, so
+// the profiler never waits on the GPU. GL_TIME_ELAPSED queries cannot nest, so a GPU
+// scope opened inside another is timed on the CPU only.
+// Disabled, every scope costs one branch. The panel shows rolling graphs per section
+// and can capture the next frames as a Chrome/Perfetto trace.
+class FrameProfiler {
+public:
+    bool enabled = false;
+
+    static const int history = 240;
+    static const int queryFrames = 4;
+
+    FrameProfiler() : origin(Clock::now()) {}
+
+    // Starts a frame, which is itself timed as the "frame" section, and collects GPU
+    // results from queryFrames frames ago
+    void beginFrame() {
+        if (!enabled) return;
+        ++frame;
+        frameSection = begin("frame", false);
+        int slot = static_cast<int>(frame % queryFrames);
+        for (Section& section : sections) {
+            section.cpu[frame % history] = 0.0f;
+            section.gpu[frame % history] = 0.0f;
+            if (!section.pending[slot]) continue;
+            section.pending[slot] = false;
+            GLint available = 0;
+            glGetQueryObjectiv(section.queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) continue;
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(section.queries[slot], GL_QUERY_RESULT, &nanoseconds);
+            // The first result from freshly generated queries is unreliable on some drivers
+            if (section.discardResult) {
+                section.discardResult = false;
+                continue;
+            }
+            float milliseconds = static_cast<float>(nanoseconds / 1e6);
+            section.gpu[(frame - queryFrames) % history] = milliseconds;
+            if (captureFramesLeft > 0 || writePending) {
+                traceEvents.push_back({ static_cast<size_t>(&section - sections.data()), section.gpuStart[slot], milliseconds * 1000.0, 0, true });
+            }
+        }
+    }
+
+    void endFrame() {
+        if (frameSection >= 0) end(frameSection);
+        frameSection = -1;
+        if (!enabled) return;
+        if (captureFramesLeft > 0 && --captureFramesLeft == 0) {
+            // Let the last frames' GPU results come in before writing
+            writePending = queryFrames;
+        }
+        else if (writePending > 0 && --writePending == 0) {
+            writeTrace();
+        }
+    }
+
+    // Opens a scope and returns its section, or -1 while disabled
+    int begin(const char* name, bool gpu) {
+        int index = findSection(name);
+        Section& section = sections[index];
+        section.start = Clock::now();
+        section.depth = depth++;
+        section.gpuActive = gpu && !gpuScopeOpen;
+        if (section.gpuActive) {
+            int slot = static_cast<int>(frame % queryFrames);
+            if (section.queries[0] == 0) {
+                glGenQueries(queryFrames, section.queries);
+                section.discardResult = true;
+            }
+            glBeginQuery(GL_TIME_ELAPSED, section.queries[slot]);
+            section.gpuStart[slot] = microseconds(section.start);
+            gpuScopeOpen = true;
+        }
+        return index;
+    }
+
+    void end(int index) {
+        Section& section = sections[index];
+        if (section.gpuActive) {
+            glEndQuery(GL_TIME_ELAPSED);
+            section.pending[frame % queryFrames] = true;
+            gpuScopeOpen = false;
+        }
+        --depth;
+        double elapsed = std::chrono::duration<double, std::micro>(Clock::now() - section.start).count();
+        section.cpu[frame % history] += static_cast<float>(elapsed / 1000.0);
+        if (captureFramesLeft > 0) {
+            traceEvents.push_back({ static_cast<size_t>(index), microseconds(section.start), elapsed, section.depth, false });
+        }
+    }
+
+    // Panel placed next to the Transformations window
+    void renderUI() {
+        ImGui::SetNextWindowPos(ImVec2(320, 10), ImGuiCond_FirstUseEver);
+        ImGui::SetNextWindowSize(ImVec2(340, 0), ImGuiCond_FirstUseEver);
+        ImGui::Begin("Profiler");
+        ImGui::Checkbox("Enabled", &enabled);
+        if (!enabled) {
+            ImGui::End();
+            return;
+        }
+
+        ImGui::SameLine();
+        if (captureFramesLeft > 0 || writePending > 0) {
+            ImGui::Text("capturing...");
+        }
+        else if (ImGui::Button("Capture trace")) {
+            traceEvents.clear();
+            captureFramesLeft = 120;
+        }
+        if (!traceStatus.empty()) ImGui::Text("%s", traceStatus.c_str());
+
+        int offset = static_cast<int>((frame + 1) % history);
+        for (Section& section : sections) {
+            float cpuAverage = average(section.cpu), gpuAverage = average(section.gpu);
+            if (section.queries[0] != 0) {
+                ImGui::Text("%-14s cpu %6.3f ms  gpu %6.3f ms", section.name, cpuAverage, gpuAverage);
+            }
+            else {
+                ImGui::Text("%-14s cpu %6.3f ms", section.name, cpuAverage);
+            }
+            std::string cpuLabel = std::string("##cpu") + section.name;
+            ImGui::PlotLines(cpuLabel.c_str(), section.cpu, history, offset, "cpu", 0.0f, FLT_MAX, ImVec2(320, 30));
+            if (section.queries[0] != 0) {
+                std::string gpuLabel = std::string("##gpu") + section.name;
+                ImGui::PlotLines(gpuLabel.c_str(), section.gpu, history, offset, "gpu", 0.0f, FLT_MAX, ImVec2(320, 30));
+            }
+        }
+        ImGui::End();
+    }
+
+    void cleanup() {
+        for (Section& section : sections) {
+            if (section.queries[0] != 0) glDeleteQueries(queryFrames, section.queries);
+        }
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Section {
+        const char* name;
+        float cpu[history] = {};
+        float gpu[history] = {};
+        GLuint queries[queryFrames] = {};
+        bool pending[queryFrames] = {};
+        double gpuStart[queryFrames] = {};
+        bool discardResult = false; // set when the queries are generated
+        Clock::time_point start;
+        int depth = 0;
+        bool gpuActive = false;
+    };
+
+    // One complete event for the trace; GPU events go on their own track at the CPU
+    // time their scope was opened
+    struct TraceEvent {
+        size_t section;
+        double start;    // microseconds since the profiler was created
+        double duration; // microseconds
+        int depth;
+        bool gpu;
+    };
+
+    std::vector<Section> sections;
+    Clock::time_point origin;
+    uint64_t frame = 0;
+    int frameSection = -1;
+    int depth = 0;
+    bool gpuScopeOpen = false;
+    int captureFramesLeft = 0;
+    int writePending = 0;
+    std::vector<TraceEvent> traceEvents;
+    std::string traceStatus;
+
+    int findSection(const char* name) {
+        for (size_t i = 0; i < sections.size(); ++i) {
+            if (sections[i].name == name || std::strcmp(sections[i].name, name) == 0) return static_cast<int>(i);
+        }
+        sections.emplace_back();
+        sections.back().name = name;
+        return static_cast<int>(sections.size() - 1);
+    }
+
+    double microseconds(Clock::time_point time) const {
+        return std::chrono::duration<double, std::micro>(time - origin).count();
+    }
+
+    // Mean over the last second or so of frames, skipping frames the section missed
+    float average(const float* values) const {
+        float sum = 0.0f;
+        int count = 0;
+        for (int i = 0; i < 60 && static_cast<uint64_t>(i) < frame; ++i) {
+            float value = values[(frame - i) % history];
+            if (value > 0.0f) {
+                sum += value;
+                ++count;
+            }
+        }
+        return count ? sum / count : 0.0f;
+    }
+
+    // Chrome trace event format, loadable in chrome://tracing and ui.perfetto.dev
+    void writeTrace() {
+        std::string path = "trace_" + std::to_string(std::time(nullptr)) + ".json";
+        std::ofstream file(path);
+        file << std::fixed << std::setprecision(3) << "{\"traceEvents\": [\n";
+        file << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 1, \"args\": {\"name\": \"CPU\"}},\n";
+        file << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 2, \"args\": {\"name\": \"GPU\"}}";
+        for (const TraceEvent& event : traceEvents) {
+            file << ",\n{\"name\": \"" << sections[event.section].name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": "
+                << (event.gpu ? 2 : 1) << ", \"ts\": " << event.start << ", \"dur\": " << event.duration << "}";
+        }
+        file << "\n]}\n";
+        traceStatus = file ? "wrote " + path : "could not write " + path;
+        traceEvents.clear();
+    }
+};
+
+// Times the enclosing block in a FrameProfiler section
+class ProfileScope {
+public:
+    ProfileScope(FrameProfiler& profiler, const char* name, bool gpu = true)
+        : profiler(profiler), section(profiler.enabled ? profiler.begin(name, gpu) : -1) {}
+
+    ~ProfileScope() {
+        if (section >= 0) profiler.end(section);
+    }
+
+private:
+    FrameProfiler& profiler;
+    int section;
+};
+
+// Linked program with its uniform locations, resolved once when it is created
+struct ShaderProgram {
+    GLuint id = 0;
+    GLint model = -1;
+    GLint view = -1;
+    GLint projection = -1;
+};
+
+// Compiles and links each vertex/fragment source pair once and hands out the same
+// program to every user. Linked programs are also written to disk with
+// glGetProgramBinary, so later launches load the binary and skip GLSL compilation.
+// A binary is only reused for the same sources on the same driver; anything the driver
+// rejects is recompiled and rewritten.
+class ProgramCache {
+private:
+    struct BinaryHeader {
+        char magic[8];
+        uint32_t version;
+        GLenum format;
+        uint64_t sourceHash;
+        uint64_t driverHash;
+        uint64_t length;
+    };
+
+    std::unordered_map<uint64_t, ShaderProgram> programs;
+    std::ostream& timingLog;
+
+    static uint64_t hashBytes(const char* data, size_t size, uint64_t hash = 1469598103934665603ull) {
+        for (size_t i = 0; i < size; ++i) {
+            hash = (hash ^ static_cast<unsigned char>(data[i])) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    static uint64_t driverHash() {
+        uint64_t hash = 1469598103934665603ull;
+        for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+            const char* value = reinterpret_cast<const char*>(glGetString(name));
+            if (value) hash = hashBytes(value, std::strlen(value) + 1, hash);
+        }
+        return hash;
+    }
+
+    static std::string binaryPath(uint64_t sourceHash) {
+        std::ostringstream path;
+        path << "program_" << std::hex << std::setw(16) << std::setfill('0') << sourceHash << ".bin";
+        return path.str();
+    }
+
+    static bool binariesSupported() {
+        if (!GLEW_ARB_get_program_binary) return false;
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats > 0;
+    }
+
+    static GLuint compile(GLenum type, const char* source) {
+        GLuint shader = glCreateShader(type);
+        glShaderSource(shader, 1, &source, NULL);
+        glCompileShader(shader);
+
+        GLint success = GL_FALSE;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+        if (!success) {
+            GLint length = 0;
+            glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+            std::string log(std::max(length, 1), '\0');
+            glGetShaderInfoLog(shader, length, NULL, &log[0]);
+            std::cerr << (type == GL_VERTEX_SHADER ? "Vertex" : "Fragment") << " shader compilation failed: " << log << std::endl;
+        }
+        return shader;
+    }
+
+    static bool linked(GLuint program, bool report) {
+        GLint success = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success && report) {
+            GLint length = 0;
+            glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+            std::string log(std::max(length, 1), '\0');
+            glGetProgramInfoLog(program, length, NULL, &log[0]);
+            std::cerr << "Shader program link failed: " << log << std::endl;
+        }
+        return success == GL_TRUE;
+    }
+
+    GLuint loadBinary(uint64_t sourceHash, uint64_t driver) {
+        std::ifstream file(binaryPath(sourceHash), std::ios::binary);
+        BinaryHeader header;
+        if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+            std::memcmp(header.magic, "GLPROGBN", 8) != 0 || header.version != 1 ||
+            header.sourceHash != sourceHash || header.driverHash != driver) {
+            return 0;
+        }
+
+        std::vector<char> binary(static_cast<size_t>(header.length));
+        if (!file.read(binary.data(), binary.size())) {
+            return 0;
+        }
+
+        GLuint program = glCreateProgram();
+        glProgramBinary(program, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+        if (!linked(program, false)) {
+            glDeleteProgram(program);
+            return 0;
+        }
+        return program;
+    }
+
+    void saveBinary(GLuint program, uint64_t sourceHash, uint64_t driver) {
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0) return;
+
+        BinaryHeader header = {};
+        std::memcpy(header.magic, "GLPROGBN", 8);
+        header.version = 1;
+        header.sourceHash = sourceHash;
+        header.driverHash = driver;
+        std::vector<char> binary(length);
+        glGetProgramBinary(program, length, NULL, &header.format, binary.data());
+        header.length = static_cast<uint64_t>(length);
+
+        // Written under a temporary name so a crash never leaves a truncated binary
+        std::string path = binaryPath(sourceHash);
+        std::string temporary = path + ".tmp";
+        {
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(binary.data(), binary.size());
+            if (!file) {
+                std::cerr << "Failed to write program binary " << path << std::endl;
+                return;
+            }
+        }
+        std::remove(path.c_str());
+        std::rename(temporary.c_str(), path.c_str());
+    }
+
+public:
+    // Compile and load times go to timingLog; the headless harness keeps them off stdout
+    explicit ProgramCache(std::ostream& timingLog = std::cout) : timingLog(timingLog) {}
+
+    // Program for this source pair, created on first use
+    const ShaderProgram& get(const char* vertexSource, const char* fragmentSource) {
+        uint64_t sourceHash = hashBytes(vertexSource, std::strlen(vertexSource) + 1);
+        sourceHash = hashBytes(fragmentSource, std::strlen(fragmentSource) + 1, sourceHash);
+
+        auto found = programs.find(sourceHash);
+        if (found != programs.end()) {
+            return found->second;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        bool useBinaries = binariesSupported();
+        uint64_t driver = useBinaries ? driverHash() : 0;
+        GLuint id = useBinaries ? loadBinary(sourceHash, driver) : 0;
+        bool fromBinary = id != 0;
+
+        if (!fromBinary) {
+            GLuint vertexShader = compile(GL_VERTEX_SHADER, vertexSource);
+            GLuint fragmentShader = compile(GL_FRAGMENT_SHADER, fragmentSource);
+
+            id = glCreateProgram();
+            if (useBinaries) {
+                glProgramParameteri(id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+            }
+            glAttachShader(id, vertexShader);
+            glAttachShader(id, fragmentShader);
+            glLinkProgram(id);
+
+            glDeleteShader(vertexShader);
+            glDeleteShader(fragmentShader);
+
+            if (!linked(id, true)) {
+                glDeleteProgram(id);
+                id = 0;
+            }
+            else if (useBinaries) {
+                saveBinary(id, sourceHash, driver);
+            }
+        }
+
+        ShaderProgram& program = programs[sourceHash];
+        program.id = id;
+        if (id != 0) {
+            program.model = glGetUniformLocation(id, "model");
+            program.view = glGetUniformLocation(id, "view");
+            program.projection = glGetUniformLocation(id, "projection");
+        }
+        timingLog << "Shader program " << (fromBinary ? "loaded from binary" : "compiled") << " in "
+            << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()
+            << " ms" << std::endl;
+        return program;
+    }
+
+    void cleanup() {
+        for (auto& entry : programs) {
+            glDeleteProgram(entry.second.id);
+        }
+        programs.clear();
+    }
+};
+
 // Common Shape class
 class Shape {
 public:
@@ -93,387 +690,4072 @@ public:
             3, 0, 4
         };
     }
+
+    // Centers the shape and scales its longest side to 1, the size of the built-in
+    // shapes, which also keeps loaded models well inside the pool's half-float range
+    void fitUnitCube() {
+        if (vertices.empty()) return;
+        glm::vec3 low(FLT_MAX), high(-FLT_MAX);
+        for (size_t v = 0; v < vertices.size(); v += 6) {
+            glm::vec3 position(vertices[v], vertices[v + 1], vertices[v + 2]);
+            low = glm::min(low, position);
+            high = glm::max(high, position);
+        }
+        glm::vec3 center = (low + high) * 0.5f, size = high - low;
+        float scale = 1.0f / std::max(std::max(size.x, size.y), std::max(size.z, 1e-20f));
+        for (size_t v = 0; v < vertices.size(); v += 6) {
+            for (int axis = 0; axis < 3; ++axis) vertices[v + axis] = (vertices[v + axis] - center[axis]) * scale;
+        }
+    }
+
+    // Colors every vertex by its position in the unit cube, like the cube's corners
+    void colorByPosition() {
+        for (size_t v = 0; v < vertices.size(); v += 6) {
+            for (int axis = 0; axis < 3; ++axis) vertices[v + 3 + axis] = std::min(std::max(vertices[v + axis] + 0.5f, 0.0f), 1.0f);
+        }
+    }
 };
 
-// Shape Selector class for intro screen
-class ShapeSelector {
-private:
-    GLuint VAO[2], VBO[2], EBO[2];
-    GLuint shaderProgram;
-    Shape shapes[2];  // cube and pyramid
-    float rotationAngle = 0.0f;
-    int selectedShape = -1;
-    glm::mat4 projection;
+// Float to IEEE half with round-to-nearest-even; values below the half range flush
+// through the subnormals to zero
+uint16_t floatToHalf(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, 4);
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t floatExponent = (bits >> 23) & 0xff;
+    uint32_t mantissa = bits & 0x7fffff;
+    if (floatExponent == 0xff) return static_cast<uint16_t>(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+
+    int exponent = static_cast<int>(floatExponent) - 127 + 15;
+    if (exponent >= 31) return static_cast<uint16_t>(sign | 0x7c00);
+    int shift = 13;
+    uint32_t half = 0;
+    if (exponent <= 0) {
+        if (exponent < -10) return static_cast<uint16_t>(sign);
+        mantissa |= 0x800000;
+        shift = 14 - exponent;
+    }
+    else {
+        half = static_cast<uint32_t>(exponent) << 10;
+    }
+    half |= mantissa >> shift;
+    uint32_t rest = mantissa & ((1u << shift) - 1), halfway = 1u << (shift - 1);
+    if (rest > halfway || (rest == halfway && (half & 1))) ++half; // a carry rounds up into the exponent
+    return static_cast<uint16_t>(sign | half);
+}
+
+// Pool vertex: half-float position and normalized 8-bit color in 12 bytes, against the
+// 24 bytes of the float position+color layout Shape builds
+struct PackedVertex {
+    uint16_t position[3];
+    uint16_t padding;
+    uint8_t color[4];
+};
+
+// Pool vertex for loaded models: float position and normalized 8-bit color in 16 bytes.
+// A half float keeps 11 significant bits, which snaps together the vertices of a finely
+// tessellated model once it is fitted to the unit cube.
+struct PreciseVertex {
+    float position[3];
+    uint8_t color[4];
+};
+
+// Where one mesh lives inside the pool
+struct PoolMesh {
+    const char* name = "";
+    GLint baseVertex = 0;
+    size_t indexOffset = 0; // bytes into the index buffer
+    GLsizei indexCount = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
+    size_t vertexCount = 0;
+    bool precise = false; // PreciseVertex instead of PackedVertex
 
+    size_t indexSize() const { return indexType == GL_UNSIGNED_SHORT ? 2 : 4; }
+    size_t vertexSize() const { return precise ? sizeof(PreciseVertex) : sizeof(PackedVertex); }
+    size_t bytes() const { return vertexCount * vertexSize() + indexCount * indexSize(); }
+    // What the mesh took with float vertices and 32-bit indices in its own buffers
+    size_t unpackedBytes() const { return vertexCount * 6 * sizeof(float) + indexCount * sizeof(unsigned int); }
+};
+
+// Every mesh is suballocated from one vertex buffer and one index buffer sharing one
+// vertex array, and drawn with base-vertex offsets, so switching meshes costs no binds.
+// The built-in shapes are converted to PackedVertex on the way in; added meshes go to a
+// second vertex buffer of PreciseVertex with its own vertex array over the same index
+// buffer. Meshes get 16-bit indices whenever their vertex count allows. Vertex array
+// binds go through bindVertexArray, which skips redundant binds and counts the rest for
+// the per-frame statistics.
+class GeometryPool {
 public:
-    ShapeSelector() {
-        setupShaders();
-        setupShapes();
-        // Get the initial window size
-        int width, height;
-        glfwGetFramebufferSize(glfwGetCurrentContext(), &width, &height);
-        updateProjection(width, height);
+    struct FrameStats {
+        size_t draws = 0;
+        size_t binds = 0;        // vertex array binds issued
+        size_t skippedBinds = 0; // binds avoided because the array was already bound
+    };
+
+    GeometryPool() {
+        glGenVertexArrays(1, &vao);
+        glGenVertexArrays(1, &preciseVao);
+        glGenBuffers(1, &vertexBuffer);
+        glGenBuffers(1, &preciseVertexBuffer);
+        glGenBuffers(1, &indexBuffer);
+
+        bindVertexArray(preciseVao);
+        glBindBuffer(GL_ARRAY_BUFFER, preciseVertexBuffer);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(PreciseVertex), (void*)offsetof(PreciseVertex, position));
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 3, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(PreciseVertex), (void*)offsetof(PreciseVertex, color));
+        glEnableVertexAttribArray(1);
+
+        bind();
+        setupAttributes();
     }
 
-    void updateProjection(int width, int height) {
-        float aspect = static_cast<float>(width) / static_cast<float>(height);
-        projection = glm::perspective(glm::radians(45.0f), aspect, 0.1f, 100.0f);
+    // Uploads the shape on first use and returns its location in the pool
+    PoolMesh get(Shape::Type type) {
+        auto found = meshIndex.find(type);
+        if (found != meshIndex.end()) return meshes[found->second];
+
+        Shape shape;
+        if (type == Shape::CUBE) shape.createCube();
+        else shape.createPyramid();
+        meshIndex[type] = meshes.size();
+        meshes.push_back(pack(type == Shape::CUBE ? "cube" : "pyramid", shape, false));
+        return meshes.back();
     }
 
-    void setupShaders() {
-        GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
-        glCompileShader(vertexShader);
+    // Converts and uploads a shape that is not one of the built-in types, such as a loaded
+    // model, with float positions; name must outlive the pool
+    PoolMesh add(const char* name, const Shape& shape) {
+        meshes.push_back(pack(name, shape, true));
+        return meshes.back();
+    }
+
+    // Points attributes 0 (position) and 1 (color) of the bound vertex array at the pool's
+    // PackedVertex buffer and attaches the pool's index buffer. Used by vertex arrays that
+    // add their own per-instance attributes to the built-in shapes.
+    void setupAttributes() {
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+        glVertexAttribPointer(0, 3, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, position));
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 3, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, color));
+        glEnableVertexAttribArray(1);
+    }
+
+    void bindVertexArray(GLuint array) {
+        if (array == boundArray) {
+            ++stats.skippedBinds;
+            return;
+        }
+        glBindVertexArray(array);
+        boundArray = array;
+        ++stats.binds;
+    }
 
-        GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
-        glCompileShader(fragmentShader);
+    void bind() { bindVertexArray(vao); }
 
-        shaderProgram = glCreateProgram();
-        glAttachShader(shaderProgram, vertexShader);
-        glAttachShader(shaderProgram, fragmentShader);
-        glLinkProgram(shaderProgram);
+    // The vertex array matching the mesh's vertex layout
+    void bind(const PoolMesh& mesh) { bindVertexArray(mesh.precise ? preciseVao : vao); }
 
-        glDeleteShader(vertexShader);
-        glDeleteShader(fragmentShader);
+    void draw(const PoolMesh& mesh) {
+        glDrawElementsBaseVertex(GL_TRIANGLES, mesh.indexCount, mesh.indexType, (void*)mesh.indexOffset, mesh.baseVertex);
+        ++stats.draws;
     }
 
-    void setupShapes() {
-        glGenVertexArrays(2, VAO);
-        glGenBuffers(2, VBO);
-        glGenBuffers(2, EBO);
+    void drawInstanced(const PoolMesh& mesh, GLsizei instances) {
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, mesh.indexCount, mesh.indexType, (void*)mesh.indexOffset,
+            instances, mesh.baseVertex);
+        ++stats.draws;
+    }
 
-        // Setup cube
-        shapes[0].createCube();
-        setupBuffers(0, shapes[0]);
+    // Starts a new frame of statistics and returns the previous one
+    FrameStats beginFrame() {
+        FrameStats previous = stats;
+        stats = FrameStats();
+        return previous;
+    }
 
-        // Setup pyramid
-        shapes[1].createPyramid();
-        setupBuffers(1, shapes[1]);
+    const FrameStats& frameStats() const { return stats; }
+
+    void report(std::ostream& out) const {
+        size_t total = 0, unpacked = 0;
+        out << "Geometry pool: " << meshes.size() << " meshes, " << vertexCapacity + preciseVertexCapacity
+            << " B vertex and " << indexCapacity << " B index buffers allocated" << std::endl;
+        for (const PoolMesh& mesh : meshes) {
+            out << "  " << std::left << std::setw(10) << mesh.name << std::right << std::setw(6) << mesh.vertexCount
+                << " vertices " << std::setw(6) << mesh.indexCount << " x " << mesh.indexSize() * 8 << "-bit indices  "
+                << std::setw(6) << mesh.bytes() << " B (float/32-bit: " << mesh.unpackedBytes() << " B)" << std::endl;
+            total += mesh.bytes();
+            unpacked += mesh.unpackedBytes();
+        }
+        out << "  total     " << total << " B (float/32-bit: " << unpacked << " B)" << std::endl;
+    }
+
+    void cleanup() {
+        glDeleteVertexArrays(1, &vao);
+        glDeleteVertexArrays(1, &preciseVao);
+        glDeleteBuffers(1, &vertexBuffer);
+        glDeleteBuffers(1, &preciseVertexBuffer);
+        glDeleteBuffers(1, &indexBuffer);
+    }
+
+private:
+    GLuint vao = 0, vertexBuffer = 0, indexBuffer = 0;
+    GLuint preciseVao = 0, preciseVertexBuffer = 0;
+    GLuint boundArray = 0;
+    size_t vertexBytes = 0, preciseVertexBytes = 0, indexBytes = 0; // in use
+    size_t vertexCapacity = 0, preciseVertexCapacity = 0, indexCapacity = 0;
+    std::vector<PoolMesh> meshes;
+    std::unordered_map<int, size_t> meshIndex;
+    FrameStats stats;
+
+    PoolMesh pack(const char* name, const Shape& shape, bool precise) {
+        PoolMesh mesh;
+        mesh.name = name;
+        mesh.precise = precise;
+        mesh.vertexCount = shape.vertices.size() / 6;
+        size_t& vertexStart = precise ? preciseVertexBytes : vertexBytes;
+        mesh.baseVertex = static_cast<GLint>(vertexStart / mesh.vertexSize());
+        mesh.indexCount = static_cast<GLsizei>(shape.indices.size());
+        mesh.indexType = mesh.vertexCount <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+
+        // Only the new mesh is converted on the CPU; earlier ones live in the buffers alone
+        std::vector<unsigned char> vertices(mesh.vertexCount * mesh.vertexSize());
+        for (size_t v = 0; v < mesh.vertexCount; ++v) {
+            const float* source = &shape.vertices[v * 6];
+            uint8_t color[4] = { 0, 0, 0, 255 };
+            for (int axis = 0; axis < 3; ++axis) {
+                color[axis] = static_cast<uint8_t>(std::lround(std::min(std::max(source[3 + axis], 0.0f), 1.0f) * 255.0f));
+            }
+            unsigned char* target = &vertices[v * mesh.vertexSize()];
+            if (precise) {
+                PreciseVertex vertex;
+                std::memcpy(vertex.position, source, sizeof(vertex.position));
+                std::memcpy(vertex.color, color, sizeof(color));
+                std::memcpy(target, &vertex, sizeof(vertex));
+            }
+            else {
+                PackedVertex packed = {};
+                for (int axis = 0; axis < 3; ++axis) packed.position[axis] = floatToHalf(source[axis]);
+                std::memcpy(packed.color, color, sizeof(color));
+                std::memcpy(target, &packed, sizeof(packed));
+            }
+        }
+
+        // Index ranges start 4-byte aligned whatever the type of the previous mesh
+        size_t indexStart = (indexBytes + 3) & ~size_t(3);
+        mesh.indexOffset = indexStart;
+        std::vector<unsigned char> indices(mesh.indexCount * mesh.indexSize());
+        for (size_t i = 0; i < shape.indices.size(); ++i) {
+            if (mesh.indexType == GL_UNSIGNED_SHORT) {
+                uint16_t index = static_cast<uint16_t>(shape.indices[i]);
+                std::memcpy(&indices[i * 2], &index, 2);
+            }
+            else {
+                std::memcpy(&indices[i * 4], &shape.indices[i], 4);
+            }
+        }
+
+        upload(precise ? preciseVertexBuffer : vertexBuffer, vertices, vertexStart, precise ? preciseVertexCapacity : vertexCapacity);
+        upload(indexBuffer, indices, indexStart, indexCapacity);
+        vertexStart += vertices.size();
+        indexBytes = indexStart + indices.size();
+        return mesh;
+    }
+
+    // Writes data at offset start of the buffer, doubling its storage when it does not
+    // fit. The bytes before start move to the new storage on the GPU through a scratch
+    // buffer, so nothing is kept or re-sent from the CPU, and the buffer keeps its name,
+    // so vertex arrays referring to it stay valid. The copy targets keep the uploads out
+    // of the bound vertex array's state.
+    static void upload(GLuint buffer, const std::vector<unsigned char>& data, size_t start, size_t& capacity) {
+        size_t end = start + data.size();
+        if (end > capacity) {
+            GLuint scratch = 0;
+            if (start > 0) {
+                glGenBuffers(1, &scratch);
+                glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+                glBindBuffer(GL_COPY_WRITE_BUFFER, scratch);
+                glBufferData(GL_COPY_WRITE_BUFFER, start, NULL, GL_STREAM_COPY);
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, start);
+            }
+            capacity = std::max<size_t>(std::max<size_t>(capacity * 2, 64 * 1024), end);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+            glBufferData(GL_COPY_WRITE_BUFFER, capacity, NULL, GL_STATIC_DRAW);
+            if (scratch) {
+                glBindBuffer(GL_COPY_READ_BUFFER, scratch);
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, start);
+                glDeleteBuffers(1, &scratch);
+            }
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        if (!data.empty()) glBufferSubData(GL_COPY_WRITE_BUFFER, start, data.size(), data.data());
+    }
+};
+
+// Reference model matrix as chained glm calls: translate, rotate X/Y/Z (degrees),
+// scale, shear, then reflect the flagged axes. The closed form below must match it.
+glm::mat4 composeModelMatrixReference(const glm::vec3& translation, const glm::vec3& rotation, const glm::vec3& scale,
+    const glm::vec3& shear, const bool reflection[3]) {
+    glm::mat4 model = glm::mat4(1.0f);
+
+    // Apply transformations in order
+    // Translation
+    model = glm::translate(model, translation);
+
+    // Rotation
+    model = glm::rotate(model, glm::radians(rotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
+    model = glm::rotate(model, glm::radians(rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
+    model = glm::rotate(model, glm::radians(rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
+
+    // Scale
+    model = glm::scale(model, scale);
+
+    // Shear
+    glm::mat4 shearMatrix(1.0f);
+    shearMatrix[0][1] = shear.y; // xy shear
+    shearMatrix[0][2] = shear.z; // xz shear
+    shearMatrix[1][0] = shear.x; // yx shear
+    shearMatrix[1][2] = shear.z; // yz shear
+    shearMatrix[2][0] = shear.x; // zx shear
+    shearMatrix[2][1] = shear.y; // zy shear
+    model = model * shearMatrix;
+
+    // Reflection
+    if (reflection[0]) model = glm::scale(model, glm::vec3(-1.0f, 1.0f, 1.0f));
+    if (reflection[1]) model = glm::scale(model, glm::vec3(1.0f, -1.0f, 1.0f));
+    if (reflection[2]) model = glm::scale(model, glm::vec3(1.0f, 1.0f, -1.0f));
+
+    return model;
+}
+
+// Closed-form model matrices. T * Rx * Ry * Rz * S * H * F has translation t and upper
+// 3x3 columns built from the scaled rotation columns u = R0 * sx, v = R1 * sy, w = R2 * sz:
+//   col0 = fx * (u + hy * v + hz * w)
+//   col1 = fy * (hx * u + v + hz * w)
+//   col2 = fz * (hx * u + hy * v + w)
+// where f is -1 for reflected axes. The kernel is written once over a lane type and
+// runs across objects: AVX2 (8), SSE2 (4) or plain floats.
+struct ScalarLanes {
+    static const int width = 1;
+    typedef float F;
+    typedef int32_t I;
+
+    static F load(const float* p) { return *p; }
+    static void store(float* p, F a) { *p = a; }
+    static F set1(float v) { return v; }
+    static F add(F a, F b) { return a + b; }
+    static F sub(F a, F b) { return a - b; }
+    static F mul(F a, F b) { return a * b; }
+    static I roundToInt(F a) { return static_cast<I>(std::nearbyint(a)); }
+    static F toFloat(I a) { return static_cast<F>(a); }
+    static I quadrantSign(I q) { return (q & 2) << 30; }
+    static I addOne(I q) { return q + 1; }
+    static F flipSign(F a, I sign) {
+        uint32_t bits;
+        std::memcpy(&bits, &a, 4);
+        bits ^= static_cast<uint32_t>(sign);
+        std::memcpy(&a, &bits, 4);
+        return a;
+    }
+    static F selectOdd(I q, F odd, F even) { return (q & 1) ? odd : even; }
+
+    // Masks and pixel stores for the software rasterizer
+    typedef bool M;
+    static F div(F a, F b) { return a / b; }
+    static F ramp() { return 0.0f; }
+    static M greaterEqual(F a, F b) { return a >= b; }
+    static M less(F a, F b) { return a < b; }
+    static M both(M a, M b) { return a && b; }
+    static bool any(M m) { return m; }
+    static F select(M m, F a, F b) { return m ? a : b; }
+    static void storeColor(uint32_t* p, M m, F r, F g, F b) {
+        if (!m) return;
+        auto channel = [](float value) { return static_cast<uint32_t>(std::lrint(std::min(std::max(value, 0.0f), 1.0f) * 255.0f)); };
+        *p = channel(r) | channel(g) << 8 | channel(b) << 16 | 0xff000000u;
     }
+};
+
+#if defined(__AVX2__)
+struct VectorLanes {
+    static const int width = 8;
+    typedef __m256 F;
+    typedef __m256i I;
+
+    static F load(const float* p) { return _mm256_loadu_ps(p); }
+    static void store(float* p, F a) { _mm256_storeu_ps(p, a); }
+    static F set1(float v) { return _mm256_set1_ps(v); }
+    static F add(F a, F b) { return _mm256_add_ps(a, b); }
+    static F sub(F a, F b) { return _mm256_sub_ps(a, b); }
+    static F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+    static I roundToInt(F a) { return _mm256_cvtps_epi32(a); }
+    static F toFloat(I a) { return _mm256_cvtepi32_ps(a); }
+    static I quadrantSign(I q) { return _mm256_slli_epi32(_mm256_and_si256(q, _mm256_set1_epi32(2)), 30); }
+    static I addOne(I q) { return _mm256_add_epi32(q, _mm256_set1_epi32(1)); }
+    static F flipSign(F a, I sign) { return _mm256_xor_ps(a, _mm256_castsi256_ps(sign)); }
+    static F selectOdd(I q, F odd, F even) {
+        __m256 mask = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(q, _mm256_set1_epi32(1)), _mm256_set1_epi32(1)));
+        return _mm256_blendv_ps(even, odd, mask);
+    }
+
+    typedef __m256 M;
+    static F div(F a, F b) { return _mm256_div_ps(a, b); }
+    static F ramp() { return _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f); }
+    static M greaterEqual(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+    static M less(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static M both(M a, M b) { return _mm256_and_ps(a, b); }
+    static bool any(M m) { return _mm256_movemask_ps(m) != 0; }
+    static F select(M m, F a, F b) { return _mm256_blendv_ps(b, a, m); }
+    static void storeColor(uint32_t* p, M m, F r, F g, F b) {
+        __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f), scale = _mm256_set1_ps(255.0f);
+        __m256i red = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(r, zero), one), scale));
+        __m256i green = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(g, zero), one), scale));
+        __m256i blue = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(b, zero), one), scale));
+        __m256i color = _mm256_or_si256(_mm256_or_si256(red, _mm256_slli_epi32(green, 8)),
+            _mm256_or_si256(_mm256_slli_epi32(blue, 16), _mm256_set1_epi32(static_cast<int>(0xff000000u))));
+        __m256i old = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), _mm256_blendv_epi8(old, color, _mm256_castps_si256(m)));
+    }
+};
+#elif defined(__SSE2__)
+struct VectorLanes {
+    static const int width = 4;
+    typedef __m128 F;
+    typedef __m128i I;
+
+    static F load(const float* p) { return _mm_loadu_ps(p); }
+    static void store(float* p, F a) { _mm_storeu_ps(p, a); }
+    static F set1(float v) { return _mm_set1_ps(v); }
+    static F add(F a, F b) { return _mm_add_ps(a, b); }
+    static F sub(F a, F b) { return _mm_sub_ps(a, b); }
+    static F mul(F a, F b) { return _mm_mul_ps(a, b); }
+    static I roundToInt(F a) { return _mm_cvtps_epi32(a); }
+    static F toFloat(I a) { return _mm_cvtepi32_ps(a); }
+    static I quadrantSign(I q) { return _mm_slli_epi32(_mm_and_si128(q, _mm_set1_epi32(2)), 30); }
+    static I addOne(I q) { return _mm_add_epi32(q, _mm_set1_epi32(1)); }
+    static F flipSign(F a, I sign) { return _mm_xor_ps(a, _mm_castsi128_ps(sign)); }
+    static F selectOdd(I q, F odd, F even) {
+        __m128 mask = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, _mm_set1_epi32(1)), _mm_set1_epi32(1)));
+        return _mm_or_ps(_mm_and_ps(mask, odd), _mm_andnot_ps(mask, even));
+    }
+
+    typedef __m128 M;
+    static F div(F a, F b) { return _mm_div_ps(a, b); }
+    static F ramp() { return _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f); }
+    static M greaterEqual(F a, F b) { return _mm_cmpge_ps(a, b); }
+    static M less(F a, F b) { return _mm_cmplt_ps(a, b); }
+    static M both(M a, M b) { return _mm_and_ps(a, b); }
+    static bool any(M m) { return _mm_movemask_ps(m) != 0; }
+    static F select(M m, F a, F b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+    static void storeColor(uint32_t* p, M m, F r, F g, F b) {
+        __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), scale = _mm_set1_ps(255.0f);
+        __m128i red = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(r, zero), one), scale));
+        __m128i green = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(g, zero), one), scale));
+        __m128i blue = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(b, zero), one), scale));
+        __m128i color = _mm_or_si128(_mm_or_si128(red, _mm_slli_epi32(green, 8)),
+            _mm_or_si128(_mm_slli_epi32(blue, 16), _mm_set1_epi32(static_cast<int>(0xff000000u))));
+        __m128i mask = _mm_castps_si128(m);
+        __m128i old = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm_or_si128(_mm_and_si128(mask, color), _mm_andnot_si128(mask, old)));
+    }
+};
+#else
+typedef ScalarLanes VectorLanes;
+#endif
+
+// sin and cos of angles in degrees. Reducing by quarter turns in degrees is exact, and
+// the remainder in [-45, 45] goes through Cephes minimax polynomials.
+template <class L>
+void sinCosDegrees(typename L::F degrees, typename L::F& s, typename L::F& c) {
+    typedef typename L::F F;
+    typename L::I quadrant = L::roundToInt(L::mul(degrees, L::set1(1.0f / 90.0f)));
+    F x = L::mul(L::sub(degrees, L::mul(L::toFloat(quadrant), L::set1(90.0f))), L::set1(0.01745329251994329577f));
+    F z = L::mul(x, x);
+
+    F sinPoly = L::add(L::mul(L::add(L::mul(L::set1(-1.9515295891e-4f), z), L::set1(8.3321608736e-3f)), z), L::set1(-1.6666654611e-1f));
+    F sinX = L::add(x, L::mul(L::mul(sinPoly, z), x));
+    F cosPoly = L::add(L::mul(L::add(L::mul(L::set1(2.443315711809948e-5f), z), L::set1(-1.388731625493765e-3f)), z),
+        L::set1(4.166664568298827e-2f));
+    F cosX = L::add(L::sub(L::set1(1.0f), L::mul(L::set1(0.5f), z)), L::mul(L::mul(cosPoly, z), z));
+
+    // Quarter turns rotate (sin, cos) -> (cos, -sin)
+    s = L::flipSign(L::selectOdd(quadrant, cosX, sinX), L::quadrantSign(quadrant));
+    c = L::flipSign(L::selectOdd(quadrant, sinX, cosX), L::quadrantSign(L::addOne(quadrant)));
+}
+
+// Structure-of-arrays transform parameters; every pointer addresses count entries.
+// Rotations are in degrees and reflect holds the X/Y/Z flags as bits 0-2.
+struct TransformBatch {
+    const float* tx; const float* ty; const float* tz;
+    const float* rx; const float* ry; const float* rz;
+    const float* sx; const float* sy; const float* sz;
+    const float* hx; const float* hy; const float* hz;
+    const unsigned char* reflect;
+    size_t count;
+};
+
+// Composes L::width matrices starting at object i
+template <class L>
+void composeLanes(const TransformBatch& b, size_t i, glm::mat4* out) {
+    typedef typename L::F F;
+    float reflectSign[3][L::width];
+    for (int lane = 0; lane < L::width; ++lane) {
+        for (int axis = 0; axis < 3; ++axis) {
+            reflectSign[axis][lane] = (b.reflect[i + lane] >> axis & 1) ? -1.0f : 1.0f;
+        }
+    }
+
+    F sa, ca, sb, cb, sc, cc;
+    sinCosDegrees<L>(L::load(b.rx + i), sa, ca);
+    sinCosDegrees<L>(L::load(b.ry + i), sb, cb);
+    sinCosDegrees<L>(L::load(b.rz + i), sc, cc);
+
+    // Rotation columns of Rx * Ry * Rz
+    F sasb = L::mul(sa, sb), casb = L::mul(ca, sb);
+    F r0[3] = { L::mul(cb, cc), L::add(L::mul(ca, sc), L::mul(sasb, cc)), L::sub(L::mul(sa, sc), L::mul(casb, cc)) };
+    F r1[3] = { L::sub(L::set1(0.0f), L::mul(cb, sc)), L::sub(L::mul(ca, cc), L::mul(sasb, sc)), L::add(L::mul(sa, cc), L::mul(casb, sc)) };
+    F r2[3] = { sb, L::sub(L::set1(0.0f), L::mul(sa, cb)), L::mul(ca, cb) };
+
+    F sx = L::load(b.sx + i), sy = L::load(b.sy + i), sz = L::load(b.sz + i);
+    F hx = L::load(b.hx + i), hy = L::load(b.hy + i), hz = L::load(b.hz + i);
+    F fx = L::load(reflectSign[0]), fy = L::load(reflectSign[1]), fz = L::load(reflectSign[2]);
+
+    float columns[3][3][L::width];
+    for (int row = 0; row < 3; ++row) {
+        F u = L::mul(r0[row], sx), v = L::mul(r1[row], sy), w = L::mul(r2[row], sz);
+        L::store(columns[0][row], L::mul(fx, L::add(u, L::add(L::mul(hy, v), L::mul(hz, w)))));
+        L::store(columns[1][row], L::mul(fy, L::add(L::mul(hx, u), L::add(v, L::mul(hz, w)))));
+        L::store(columns[2][row], L::mul(fz, L::add(L::mul(hx, u), L::add(L::mul(hy, v), w))));
+    }
+
+    for (int lane = 0; lane < L::width; ++lane) {
+        glm::mat4& m = out[i + lane];
+        for (int column = 0; column < 3; ++column) {
+            m[column] = glm::vec4(columns[column][0][lane], columns[column][1][lane], columns[column][2][lane], 0.0f);
+        }
+        m[3] = glm::vec4(b.tx[i + lane], b.ty[i + lane], b.tz[i + lane], 1.0f);
+    }
+}
+
+// Thread pool for many small, independent tasks. Each run deals the task indices out
+// in contiguous blocks, one deque per worker; a worker pops from the back of its own
+// deque and, when that is empty, steals from the front of the others'. The calling
+// thread works as worker 0, so a pool of one thread runs everything inline.
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(unsigned threadCount) {
+        threadCount = std::max(1u, threadCount);
+        for (unsigned i = 0; i < threadCount; ++i) queues.emplace_back(new Queue());
+        for (unsigned i = 1; i < threadCount; ++i) workers.emplace_back(&WorkStealingPool::workerLoop, this, i);
+    }
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers) worker.join();
+    }
+
+    unsigned size() const { return static_cast<unsigned>(queues.size()); }
+
+    // Runs task(index, worker) for every index below taskCount and returns when all are done
+    void run(size_t taskCount, const std::function<void(size_t, unsigned)>& task) {
+        if (taskCount == 0) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &task;
+            remaining = taskCount;
+            size_t perQueue = (taskCount + queues.size() - 1) / queues.size();
+            for (size_t q = 0; q < queues.size(); ++q) {
+                std::lock_guard<std::mutex> queueLock(queues[q]->mutex);
+                for (size_t index = q * perQueue; index < std::min(taskCount, (q + 1) * perQueue); ++index) {
+                    queues[q]->tasks.push_back(index);
+                }
+            }
+            ++generation;
+        }
+        wake.notify_all();
+        drain(0);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [this]() { return remaining == 0; });
+        job = nullptr;
+    }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<size_t> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake, finished;
+    const std::function<void(size_t, unsigned)>* job = nullptr;
+    size_t remaining = 0;
+    uint64_t generation = 0;
+    bool stopping = false;
+
+    bool take(unsigned worker, size_t& task) {
+        {
+            Queue& own = *queues[worker];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                task = own.tasks.back();
+                own.tasks.pop_back();
+                return true;
+            }
+        }
+        for (size_t offset = 1; offset < queues.size(); ++offset) {
+            Queue& victim = *queues[(worker + offset) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = victim.tasks.front();
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void drain(unsigned worker) {
+        size_t task;
+        while (take(worker, task)) {
+            (*job)(task, worker);
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--remaining == 0) finished.notify_all();
+        }
+    }
+
+    void workerLoop(unsigned worker) {
+        uint64_t seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&]() { return stopping || generation != seen; });
+                if (stopping) return;
+                seen = generation;
+            }
+            drain(worker);
+        }
+    }
+};
+
+// Writes batch.count model matrices to out. Batches above a few thousand objects are
+// split across the pool's threads; without a pool everything runs on the caller.
+void composeModelMatrices(const TransformBatch& batch, glm::mat4* out, WorkStealingPool* pool = nullptr) {
+    auto composeRange = [&batch, out](size_t begin, size_t end) {
+        size_t i = begin;
+        for (; i + VectorLanes::width <= end; i += VectorLanes::width) {
+            composeLanes<VectorLanes>(batch, i, out);
+        }
+        for (; i < end; ++i) {
+            composeLanes<ScalarLanes>(batch, i, out);
+        }
+    };
+
+    const size_t minPerTask = 4096;
+    size_t taskCount = pool ? std::min<size_t>(pool->size(), std::max<size_t>(1, batch.count / minPerTask)) : 1;
+    if (taskCount <= 1) {
+        composeRange(0, batch.count);
+        return;
+    }
+
+    size_t perTask = (batch.count + taskCount - 1) / taskCount;
+    pool->run(taskCount, [&](size_t task, unsigned) {
+        size_t begin = std::min(batch.count, task * perTask);
+        composeRange(begin, std::min(batch.count, begin + perTask));
+    });
+}
+
+// Single-object form used by the transformation renderer
+glm::mat4 composeModelMatrix(const glm::vec3& translation, const glm::vec3& rotation, const glm::vec3& scale,
+    const glm::vec3& shear, const bool reflection[3]) {
+    unsigned char reflect = (reflection[0] ? 1 : 0) | (reflection[1] ? 2 : 0) | (reflection[2] ? 4 : 0);
+    TransformBatch batch = { &translation.x, &translation.y, &translation.z, &rotation.x, &rotation.y, &rotation.z,
+        &scale.x, &scale.y, &scale.z, &shear.x, &shear.y, &shear.z, &reflect, 1 };
+    glm::mat4 model;
+    composeLanes<ScalarLanes>(batch, 0, &model);
+    return model;
+}
+
+// Shape Selector class for intro screen
+class ShapeSelector {
+private:
+    ProgramCache& programCache;
+    GeometryPool& geometry;
+    ShaderProgram shaderProgram;
+    PoolMesh meshes[2];  // cube and pyramid
+    float rotationAngle = 0.0f;
+    int selectedShape = -1;
+    glm::mat4 projection;
+
+public:
+    ShapeSelector(ProgramCache& cache, GeometryPool& pool) : programCache(cache), geometry(pool) {
+        setupShaders();
+        setupShapes();
+        // Get the initial window size; offscreen users set the projection themselves
+        if (GLFWwindow* window = glfwGetCurrentContext()) {
+            int width, height;
+            glfwGetFramebufferSize(window, &width, &height);
+            updateProjection(width, height);
+        }
+    }
+
+    void updateProjection(int width, int height) {
+        float aspect = static_cast<float>(width) / static_cast<float>(height);
+        projection = glm::perspective(glm::radians(45.0f), aspect, 0.1f, 100.0f);
+    }
+
+    void setupShaders() {
+        shaderProgram = programCache.get(vertexShaderSource, fragmentShaderSource);
+    }
+
+    void setupShapes() {
+        meshes[0] = geometry.get(Shape::CUBE);
+        meshes[1] = geometry.get(Shape::PYRAMID);
+    }
+
+    static constexpr float rotationSpeed = 6.0f; // degrees per second
+
+    // Spins the preview shapes at a fixed rate whatever the frame rate
+    static float advanceRotation(float angle, float deltaTime) {
+        return std::fmod(angle + rotationSpeed * deltaTime, 360.0f);
+    }
+
+    void update(float deltaTime) {
+        rotationAngle = advanceRotation(rotationAngle, deltaTime);
+    }
+
+    // For rotations advanced elsewhere, such as on the update thread
+    void setRotation(float angle) { rotationAngle = angle; }
+
+    // Camera and model matrices of the preview, shared with the software backend
+    static glm::mat4 viewMatrix() {
+        return glm::lookAt(glm::vec3(0.0f, 0.0f, 5.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    }
+
+    // Cube on the left (0), pyramid on the right (1)
+    static glm::mat4 modelMatrix(int shape, float angle) {
+        glm::mat4 model = glm::mat4(1.0f);
+        model = glm::translate(model, glm::vec3(shape == 0 ? -1.5f : 1.5f, 0.0f, 0.0f));
+        return glm::rotate(model, glm::radians(angle), glm::vec3(0.5f, 1.0f, 0.0f));
+    }
+
+    void render() {
+        glUseProgram(shaderProgram.id);
+
+        // Setup camera view
+        glm::mat4 view = viewMatrix();
+        glUniformMatrix4fv(shaderProgram.view, 1, GL_FALSE, glm::value_ptr(view));
+        glUniformMatrix4fv(shaderProgram.projection, 1, GL_FALSE, glm::value_ptr(projection));
+
+        // Render cube (left side) and pyramid (right side)
+        geometry.bind();
+        for (int shape = 0; shape < 2; ++shape) {
+            glm::mat4 model = modelMatrix(shape, rotationAngle);
+            glUniformMatrix4fv(shaderProgram.model, 1, GL_FALSE, glm::value_ptr(model));
+            geometry.draw(meshes[shape]);
+        }
+    }
+
+    // Selection buttons under the preview shapes
+    void renderUI() {
+        ImGui::SetNextWindowPos(ImVec2(ImGui::GetIO().DisplaySize.x * 0.5f, ImGui::GetIO().DisplaySize.y * 0.8f),
+            ImGuiCond_Always, ImVec2(0.5f, 0.5f));
+        ImGui::Begin("Shape Selection", nullptr,
+            ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoTitleBar);
+
+        ImGui::Text("Choose a shape to begin:");
+        ImGui::Spacing();
+
+        if (ImGui::Button("Select Cube", ImVec2(120, 40))) selectedShape = 0;
+        ImGui::SameLine(0, 20);
+        if (ImGui::Button("Select Pyramid", ImVec2(120, 40))) selectedShape = 1;
+        ImGui::SameLine(0, 20);
+        if (ImGui::Button("Instanced Scene", ImVec2(120, 40))) selectedShape = SCENE;
+
+        ImGui::End();
+    }
+
+    // Selection value for the instanced scene instead of a single shape
+    static const int SCENE = 2;
+
+    int getSelectedShape() const { return selectedShape; }
+};
+
+// Renderer class for transformation mode
+class Renderer {
+private:
+    ProgramCache& programCache;
+    GeometryPool& geometry;
+    ShaderProgram shaderProgram;
+    PoolMesh currentMesh;
+    GLFWwindow* window;
+
+    // Default values for reset
+    const glm::vec3 DEFAULT_TRANSLATION{ 0.0f };
+    const glm::vec3 DEFAULT_ROTATION{ 0.0f };
+    const glm::vec3 DEFAULT_SCALE{ 1.0f };
+    const glm::vec3 DEFAULT_SHEAR{ 0.0f };
+    const glm::vec3 DEFAULT_CAMERA_POS{ 0.0f, 0.0f, 3.0f };
+
+    // Transformation parameters
+    glm::vec3 translation{ 0.0f };
+    glm::vec3 rotation{ 0.0f };
+    glm::vec3 scale{ 1.0f };
+    glm::vec3 shear{ 0.0f };
+    bool reflection[3] = { false, false, false };
+
+    // Camera parameters
+    glm::vec3 cameraPos{ 0.0f, 0.0f, 3.0f };
+    glm::mat4 projection;
+
+    // Set whenever a transform, the camera or the projection changes
+    bool dirty = true;
+
+    bool isFullscreen = false;
+    GLFWmonitor* primaryMonitor;
+    int windowed_x, windowed_y, windowed_width, windowed_height;
+
+public:
+    // win may be null for offscreen rendering, which sets the projection size itself
+    Renderer(GLFWwindow* win, ProgramCache& cache, GeometryPool& pool) : programCache(cache), geometry(pool), window(win) {
+        primaryMonitor = window ? glfwGetPrimaryMonitor() : nullptr;
+        setupShaders();
+        if (window) updateProjection();
+    }
+
+    // Both shapes already live in the pool, so switching is just picking the other range
+    void setShape(Shape::Type shapeType) {
+        setMesh(geometry.get(shapeType));
+    }
+
+    // Any mesh in the pool, such as a loaded model
+    void setMesh(const PoolMesh& mesh) {
+        currentMesh = mesh;
+        dirty = true;
+    }
+
+    void updateProjection() {
+        int width, height;
+        glfwGetFramebufferSize(window, &width, &height);
+        updateProjection(width, height);
+    }
+
+    void updateProjection(int width, int height) {
+        projection = glm::perspective(glm::radians(45.0f), (float)width / (float)std::max(height, 1), 0.1f, 100.0f);
+        dirty = true;
+    }
+
+    // Sets every transform at once, for scripted runs
+    void setTransform(const glm::vec3& newTranslation, const glm::vec3& newRotation, const glm::vec3& newScale,
+        const glm::vec3& newShear, const bool newReflection[3]) {
+        translation = newTranslation;
+        rotation = newRotation;
+        scale = newScale;
+        shear = newShear;
+        std::copy(newReflection, newReflection + 3, reflection);
+        dirty = true;
+    }
+
+    // Whether anything changed since the last call
+    bool takeDirty() {
+        bool wasDirty = dirty;
+        dirty = false;
+        return wasDirty;
+    }
+
+    void resetTransformations() {
+        translation = DEFAULT_TRANSLATION;
+        rotation = DEFAULT_ROTATION;
+        scale = DEFAULT_SCALE;
+        shear = DEFAULT_SHEAR;
+        cameraPos = DEFAULT_CAMERA_POS;
+        reflection[0] = reflection[1] = reflection[2] = false;
+        dirty = true;
+    }
+
+    void toggleFullscreen() {
+        if (!isFullscreen) {
+            glfwGetWindowPos(window, &windowed_x, &windowed_y);
+            glfwGetWindowSize(window, &windowed_width, &windowed_height);
+            const GLFWvidmode* mode = glfwGetVideoMode(primaryMonitor);
+            glfwSetWindowMonitor(window, primaryMonitor, 0, 0, mode->width, mode->height, mode->refreshRate);
+        }
+        else {
+            glfwSetWindowMonitor(window, nullptr, windowed_x, windowed_y, windowed_width, windowed_height, 0);
+        }
+        isFullscreen = !isFullscreen;
+        updateProjection();
+    }
+
+    void setupShaders() {
+        shaderProgram = programCache.get(vertexShaderSource, fragmentShaderSource);
+    }
+
+    void renderUI() {
+        // Set up ImGui window for transformations
+        ImGui::SetNextWindowPos(ImVec2(10, 10), ImGuiCond_FirstUseEver);
+        ImGui::SetNextWindowSize(ImVec2(300, 400), ImGuiCond_FirstUseEver);
+        ImGui::Begin("Transformations");
+
+        // Translation controls
+        ImGui::Text("Translation");
+        dirty |= ImGui::SliderFloat("X##Trans", &translation.x, -2.0f, 2.0f);
+        dirty |= ImGui::SliderFloat("Y##Trans", &translation.y, -2.0f, 2.0f);
+        dirty |= ImGui::SliderFloat("Z##Trans", &translation.z, -2.0f, 2.0f);
+
+        ImGui::Separator();
+
+        // Rotation controls
+        ImGui::Text("Rotation");
+        dirty |= ImGui::SliderFloat("X##Rot", &rotation.x, 0.0f, 360.0f);
+        dirty |= ImGui::SliderFloat("Y##Rot", &rotation.y, 0.0f, 360.0f);
+        dirty |= ImGui::SliderFloat("Z##Rot", &rotation.z, 0.0f, 360.0f);
+
+        ImGui::Separator();
+
+        // Scale controls
+        ImGui::Text("Scale");
+        dirty |= ImGui::SliderFloat("X##Scale", &scale.x, 0.1f, 2.0f);
+        dirty |= ImGui::SliderFloat("Y##Scale", &scale.y, 0.1f, 2.0f);
+        dirty |= ImGui::SliderFloat("Z##Scale", &scale.z, 0.1f, 2.0f);
+
+        ImGui::Separator();
+
+        // Shear controls
+        ImGui::Text("Shear");
+        dirty |= ImGui::SliderFloat("X##Shear", &shear.x, -1.0f, 1.0f);
+        dirty |= ImGui::SliderFloat("Y##Shear", &shear.y, -1.0f, 1.0f);
+        dirty |= ImGui::SliderFloat("Z##Shear", &shear.z, -1.0f, 1.0f);
+
+        ImGui::Separator();
+
+        // Reflection controls
+        ImGui::Text("Reflection");
+        dirty |= ImGui::Checkbox("X-axis##Refl", &reflection[0]);
+        dirty |= ImGui::Checkbox("Y-axis##Refl", &reflection[1]);
+        dirty |= ImGui::Checkbox("Z-axis##Refl", &reflection[2]);
+
+        ImGui::Separator();
+
+        // Camera controls
+        ImGui::Text("Camera Position");
+        dirty |= ImGui::SliderFloat("X##Cam", &cameraPos.x, -5.0f, 5.0f);
+        dirty |= ImGui::SliderFloat("Y##Cam", &cameraPos.y, -5.0f, 5.0f);
+        dirty |= ImGui::SliderFloat("Z##Cam", &cameraPos.z, 0.1f, 10.0f);
+
+        ImGui::Separator();
+
+        // Reset and fullscreen buttons
+        if (ImGui::Button("Reset Transformations")) {
+            resetTransformations();
+        }
+
+        if (ImGui::Button("Toggle Fullscreen")) {
+            toggleFullscreen();
+        }
+
+        ImGui::End();
+    }
+
+    void render() {
+        glUseProgram(shaderProgram.id);
+
+        // Create view matrix
+        glm::mat4 view = glm::lookAt(
+            cameraPos,
+            glm::vec3(0.0f, 0.0f, 0.0f),
+            glm::vec3(0.0f, 1.0f, 0.0f)
+        );
+
+        // Create transformation matrix
+        glm::mat4 model = composeModelMatrix(translation, rotation, scale, shear, reflection);
+
+        // Set uniforms
+        glUniformMatrix4fv(shaderProgram.model, 1, GL_FALSE, glm::value_ptr(model));
+        glUniformMatrix4fv(shaderProgram.view, 1, GL_FALSE, glm::value_ptr(view));
+        glUniformMatrix4fv(shaderProgram.projection, 1, GL_FALSE, glm::value_ptr(projection));
+
+        // Draw the shape
+        geometry.bind(currentMesh);
+        geometry.draw(currentMesh);
+    }
+};
+
+// Scene mode: large numbers of transformed cubes and pyramids. Transform parameters
+// are kept as structure-of-arrays, one array per component, and the model matrices are
+// rebuilt into one instance buffer every frame, cubes first, so each mesh type is drawn
+// with a single instanced draw from the geometry pool.
+class InstancedScene {
+public:
+    // Per-instance transform components; reflect holds the X/Y/Z flags as bits 0-2
+    struct InstanceArrays {
+        std::vector<float> tx, ty, tz;
+        std::vector<float> rx, ry, rz;
+        std::vector<float> sx, sy, sz;
+        std::vector<float> hx, hy, hz;
+        std::vector<unsigned char> reflect;
+        std::vector<float> spin; // degrees per second around Y
+
+        size_t size() const { return tx.size(); }
+
+        TransformBatch batch() const {
+            TransformBatch b = { tx.data(), ty.data(), tz.data(), rx.data(), ry.data(), rz.data(),
+                sx.data(), sy.data(), sz.data(), hx.data(), hy.data(), hz.data(), reflect.data(), size() };
+            return b;
+        }
+
+        void resize(size_t count) {
+            for (std::vector<float>* component : { &tx, &ty, &tz, &rx, &ry, &rz, &sx, &sy, &sz, &hx, &hy, &hz, &spin }) {
+                component->resize(count);
+            }
+            reflect.resize(count);
+        }
+    };
+
+private:
+    ProgramCache& programCache;
+    ShaderProgram instancedProgram;
+    ShaderProgram objectProgram;
+    GeometryPool& geometry;
+    GLuint vao = 0, instanceVBO = 0;
+    PoolMesh meshes[2];
+    InstanceArrays instances[2];
+    std::vector<glm::mat4> matrices[2];
+    float extent = 1.0f;
+    WorkStealingPool matrixPool;
+
+public:
+    InstancedScene(ProgramCache& cache, GeometryPool& pool)
+        : programCache(cache), geometry(pool), matrixPool(std::max(1u, std::thread::hardware_concurrency())) {
+        instancedProgram = programCache.get(instancedVertexShaderSource, fragmentShaderSource);
+        objectProgram = programCache.get(vertexShaderSource, fragmentShaderSource);
+        meshes[0] = geometry.get(Shape::CUBE);
+        meshes[1] = geometry.get(Shape::PYRAMID);
+
+        // Pool geometry plus the instance matrices; the matrix attributes are pointed at
+        // each mesh's part of the instance buffer before its draw
+        glGenVertexArrays(1, &vao);
+        glGenBuffers(1, &instanceVBO);
+        geometry.bindVertexArray(vao);
+        geometry.setupAttributes();
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        for (int column = 0; column < 4; ++column) {
+            glEnableVertexAttribArray(2 + column);
+            glVertexAttribDivisor(2 + column, 1);
+        }
+    }
+
+    // Lays count instances out on a jittered grid, alternating cubes and pyramids, with
+    // random rotation, scale, shear and reflection
+    void populate(size_t count, unsigned seed = 1) {
+        extent = populateArrays(instances, count, seed);
+        for (int mesh = 0; mesh < 2; ++mesh) {
+            matrices[mesh].resize(instances[mesh].size());
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, count * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+    }
+
+    // The CPU side of populate, also used by the software backend; returns the grid extent
+    static float populateArrays(InstanceArrays (&arrays)[2], size_t count, unsigned seed) {
+        size_t perMesh[2] = { (count + 1) / 2, count / 2 };
+        int side = 1;
+        while (static_cast<size_t>(side) * side * side < count) ++side;
+        const float spacing = 1.5f;
+
+        uint32_t state = seed * 2654435761u + 1;
+        auto random = [&state](float low, float high) {
+            state ^= state << 13; state ^= state >> 17; state ^= state << 5;
+            return low + (high - low) * (state & 0xffffff) / 16777215.0f;
+        };
+
+        for (int mesh = 0; mesh < 2; ++mesh) {
+            InstanceArrays& meshArrays = arrays[mesh];
+            meshArrays.resize(perMesh[mesh]);
+            for (size_t i = 0; i < perMesh[mesh]; ++i) {
+                size_t cell = i * 2 + mesh;
+                meshArrays.tx[i] = (static_cast<float>(cell % side) - side * 0.5f) * spacing + random(-0.2f, 0.2f);
+                meshArrays.ty[i] = (static_cast<float>(cell / side % side) - side * 0.5f) * spacing + random(-0.2f, 0.2f);
+                meshArrays.tz[i] = (static_cast<float>(cell / side / side) - side * 0.5f) * spacing + random(-0.2f, 0.2f);
+                meshArrays.rx[i] = random(0.0f, 360.0f);
+                meshArrays.ry[i] = random(0.0f, 360.0f);
+                meshArrays.rz[i] = random(0.0f, 360.0f);
+                meshArrays.sx[i] = random(0.5f, 1.0f);
+                meshArrays.sy[i] = random(0.5f, 1.0f);
+                meshArrays.sz[i] = random(0.5f, 1.0f);
+                meshArrays.hx[i] = random(-0.3f, 0.3f);
+                meshArrays.hy[i] = random(-0.3f, 0.3f);
+                meshArrays.hz[i] = random(-0.3f, 0.3f);
+                meshArrays.reflect[i] = static_cast<unsigned char>(random(0.0f, 8.0f)) & 7;
+                meshArrays.spin[i] = random(-90.0f, 90.0f);
+            }
+        }
+        return side * spacing;
+    }
+
+    size_t size() const { return instances[0].size() + instances[1].size(); }
+
+    // Distance at which the whole grid fits a 45 degree view
+    float viewDistance() const { return viewDistance(extent); }
+    static float viewDistance(float extent) { return extent * 1.5f + 3.0f; }
+
+    // Slow orbit around the grid at the given distance, angle in radians
+    static void orbitCamera(float angle, float distance, float aspect, glm::mat4& view, glm::mat4& projection) {
+        view = glm::lookAt(glm::vec3(std::sin(angle) * distance, distance * 0.3f, std::cos(angle) * distance),
+            glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        projection = glm::perspective(glm::radians(45.0f), aspect, 0.1f, distance * 4.0f);
+    }
+
+    // Advances the per-instance spin
+    void update(float deltaTime) {
+        for (InstanceArrays& arrays : instances) {
+            spin(arrays, deltaTime);
+        }
+    }
+
+    static void spin(InstanceArrays& arrays, float deltaTime) {
+        for (size_t i = 0; i < arrays.size(); ++i) {
+            arrays.ry[i] += arrays.spin[i] * deltaTime;
+            if (arrays.ry[i] >= 360.0f) arrays.ry[i] -= 360.0f;
+            if (arrays.ry[i] < 0.0f) arrays.ry[i] += 360.0f;
+        }
+    }
+
+    // Rebuilds every model matrix from the component arrays
+    void buildMatrices() {
+        for (int mesh = 0; mesh < 2; ++mesh) {
+            composeModelMatrices(instances[mesh].batch(), matrices[mesh].data(), &matrixPool);
+        }
+    }
+
+    // One instanced draw per mesh type; the instance buffer is orphaned and refilled
+    void render(const glm::mat4& view, const glm::mat4& projection) {
+        buildMatrices();
+        draw(view, projection, matrices);
+    }
+
+    // Draws matrices built elsewhere, such as an UpdateThread snapshot
+    void draw(const glm::mat4& view, const glm::mat4& projection, const std::vector<glm::mat4> (&matrices)[2]) {
+        glUseProgram(instancedProgram.id);
+        glUniformMatrix4fv(instancedProgram.view, 1, GL_FALSE, glm::value_ptr(view));
+        glUniformMatrix4fv(instancedProgram.projection, 1, GL_FALSE, glm::value_ptr(projection));
+
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, (matrices[0].size() + matrices[1].size()) * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, matrices[0].size() * sizeof(glm::mat4), matrices[0].data());
+        glBufferSubData(GL_ARRAY_BUFFER, matrices[0].size() * sizeof(glm::mat4), matrices[1].size() * sizeof(glm::mat4),
+            matrices[1].data());
+
+        geometry.bindVertexArray(vao);
+        size_t firstInstance = 0;
+        for (int mesh = 0; mesh < 2; ++mesh) {
+            if (matrices[mesh].empty()) continue;
+            // A mat4 attribute takes four vec4 slots, advanced once per instance
+            for (int column = 0; column < 4; ++column) {
+                glVertexAttribPointer(2 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                    (void*)(firstInstance * sizeof(glm::mat4) + column * sizeof(glm::vec4)));
+            }
+            geometry.drawInstanced(meshes[mesh], static_cast<GLsizei>(matrices[mesh].size()));
+            firstInstance += matrices[mesh].size();
+        }
+    }
+
+    // The same scene drawn the way Renderer draws its shape: one model uniform and one
+    // draw per object. Only used for comparison.
+    void renderPerObject(const glm::mat4& view, const glm::mat4& projection) {
+        buildMatrices();
+        drawPerObject(view, projection, matrices);
+    }
+
+    void drawPerObject(const glm::mat4& view, const glm::mat4& projection, const std::vector<glm::mat4> (&matrices)[2]) {
+        glUseProgram(objectProgram.id);
+        glUniformMatrix4fv(objectProgram.view, 1, GL_FALSE, glm::value_ptr(view));
+        glUniformMatrix4fv(objectProgram.projection, 1, GL_FALSE, glm::value_ptr(projection));
+
+        geometry.bind();
+        for (int mesh = 0; mesh < 2; ++mesh) {
+            for (const glm::mat4& model : matrices[mesh]) {
+                glUniformMatrix4fv(objectProgram.model, 1, GL_FALSE, glm::value_ptr(model));
+                geometry.draw(meshes[mesh]);
+            }
+        }
+    }
+
+    void cleanup() {
+        geometry.bind();
+        glDeleteVertexArrays(1, &vao);
+        glDeleteBuffers(1, &instanceVBO);
+    }
+};
+
+// Lock-free single-producer, single-consumer triple buffer. The producer fills back()
+// and publishes it; the consumer calls acquire() and reads front(), which holds the
+// newest published value and never changes under it. Publishing swaps the back slot
+// with the spare and acquiring swaps the spare with the front, so neither side ever
+// waits for the other; values published between two acquires are skipped.
+template <class T>
+class TripleBuffer {
+public:
+    T& back() { return slots[backIndex]; }
+
+    void publish() {
+        unsigned previous = spare.exchange(backIndex | FRESH, std::memory_order_acq_rel);
+        backIndex = previous & INDEX_MASK;
+    }
+
+    // Takes the newest published value; false when nothing was published since the last call
+    bool acquire() {
+        if (!(spare.load(std::memory_order_relaxed) & FRESH)) return false;
+        unsigned previous = spare.exchange(frontIndex, std::memory_order_acq_rel);
+        frontIndex = previous & INDEX_MASK;
+        return true;
+    }
+
+    const T& front() const { return slots[frontIndex]; }
+
+private:
+    static const unsigned FRESH = 4, INDEX_MASK = 3;
+    T slots[3];
+    std::atomic<unsigned> spare{ 1 };
+    unsigned backIndex = 0, frontIndex = 2;
+};
+
+// Everything the GL thread needs to draw one animated frame. Snapshot slots are reused,
+// so the matrix vectors keep their capacity from one tick to the next.
+struct FrameSnapshot {
+    uint64_t tick = 0;          // update tick that produced it; 0 until the first one
+    int mode = -1;              // UpdateThread::Mode it was made for
+    double inputTime = 0.0;     // newest input the request it was made from had seen
+    float selectorAngle = 0.0f;
+    glm::mat4 view{ 1.0f };
+    glm::mat4 projection{ 1.0f };
+    std::vector<glm::mat4> matrices[2];  // scene instances, cubes then pyramids
+};
+
+// Runs the animation on its own thread at a fixed rate: the selector spin and, for the
+// instanced scene, the per-instance spin, the orbit camera and every model matrix.
+// Requests (mode, scene size, framebuffer size, input time) come in from the main
+// thread and snapshots go out to the GL thread through triple buffers, so a slow swap
+// or a vsync wait never holds the simulation up, and the GL thread always draws the
+// newest snapshot. The transformation screen has nothing to animate and stays on the
+// main thread; in IDLE mode the thread answers each request once and then sleeps until
+// the next one instead of ticking.
+class UpdateThread {
+public:
+    enum Mode { INTRO, SCENE, IDLE };
+
+    struct Request {
+        int mode = INTRO;
+        size_t sceneInstances = 100000;
+        int width = 1, height = 1;
+        double inputTime = 0.0;
+    };
+
+    explicit UpdateThread(double rate = 120.0) : period(1.0 / std::max(rate, 1.0)) {
+        worker = std::thread(&UpdateThread::run, this);
+    }
+
+    ~UpdateThread() {
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            stopping.store(true, std::memory_order_release);
+        }
+        wake.notify_one();
+        worker.join();
+    }
+
+    void request(const Request& next) {
+        requests.back() = next;
+        requests.publish();
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            requested = true;
+        }
+        wake.notify_one();
+    }
+
+    // The newest snapshot; stays valid until the next call
+    const FrameSnapshot& latest() {
+        snapshots.acquire();
+        return snapshots.front();
+    }
+
+    uint64_t ticks() const { return tickCount.load(std::memory_order_relaxed); }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    std::chrono::duration<double> period;
+    TripleBuffer<Request> requests;
+    TripleBuffer<FrameSnapshot> snapshots;
+    std::atomic<bool> stopping{ false };
+    std::atomic<uint64_t> tickCount{ 0 };
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    bool requested = false; // a request arrived since the thread last went idle
+    std::thread worker;
+
+    void run() {
+        Request current;
+        float selectorAngle = 0.0f, sceneAngle = 0.0f, extent = 1.0f;
+        size_t populated = 0;
+        InstancedScene::InstanceArrays arrays[2];
+        WorkStealingPool matrixPool(std::max(1u, std::thread::hardware_concurrency()));
+
+        Clock::time_point previous = Clock::now(), next = previous;
+        while (!stopping.load(std::memory_order_acquire)) {
+            if (requests.acquire()) current = requests.front();
+            Clock::time_point now = Clock::now();
+            float deltaTime = static_cast<float>(std::min(std::chrono::duration<double>(now - previous).count(), 0.1));
+            previous = now;
+
+            FrameSnapshot& snapshot = snapshots.back();
+            snapshot.tick = tickCount.fetch_add(1, std::memory_order_relaxed) + 1;
+            snapshot.mode = current.mode;
+            snapshot.inputTime = current.inputTime;
+            if (current.mode == INTRO) {
+                selectorAngle = ShapeSelector::advanceRotation(selectorAngle, deltaTime);
+                snapshot.selectorAngle = selectorAngle;
+            }
+            else if (current.mode == SCENE) {
+                if (populated != current.sceneInstances) {
+                    extent = InstancedScene::populateArrays(arrays, current.sceneInstances, 1);
+                    populated = current.sceneInstances;
+                }
+                sceneAngle += deltaTime * 0.2f;
+                InstancedScene::orbitCamera(sceneAngle, InstancedScene::viewDistance(extent),
+                    static_cast<float>(current.width) / std::max(current.height, 1), snapshot.view, snapshot.projection);
+                for (int mesh = 0; mesh < 2; ++mesh) {
+                    InstancedScene::spin(arrays[mesh], deltaTime);
+                    snapshot.matrices[mesh].resize(arrays[mesh].size());
+                    composeModelMatrices(arrays[mesh].batch(), snapshot.matrices[mesh].data(), &matrixPool);
+                }
+            }
+            snapshots.publish();
+
+            if (current.mode == IDLE) {
+                std::unique_lock<std::mutex> lock(wakeMutex);
+                wake.wait(lock, [this]() { return requested || stopping.load(std::memory_order_acquire); });
+                requested = false;
+                previous = next = Clock::now();
+                continue;
+            }
+
+            // Fixed rate; a tick that ran long starts the next one right away
+            next += std::chrono::duration_cast<Clock::duration>(period);
+            now = Clock::now();
+            if (next < now) next = now;
+            std::this_thread::sleep_until(next);
+        }
+    }
+};
+
+// CPU renderer for the Shape pipeline, for nodes without a GL driver. It applies the
+// same model/view/projection transform as the vertex shader, clips against the near
+// plane, and rasterizes with a depth buffer (GL_LESS) and perspective-correct color
+// interpolation, following GL's pixel-center and top-left fill conventions.
+//
+// draw() only records the mesh and matrix. flush() transforms and sets up the triangles
+// in parallel chunks, each chunk binning its triangles into 64x64 screen tiles, then
+// rasterizes the tiles in parallel on a work-stealing pool. A tile walks the chunks in
+// submission order, so depth ties resolve as on a GPU. Edge functions, depth and colors
+// are evaluated VectorLanes::width pixels at a time.
+class SoftwareRasterizer {
+public:
+    static const int tileSize = 64;
+
+    SoftwareRasterizer(int width, int height, unsigned threadCount)
+        : framebufferWidth(width), framebufferHeight(height), pool(threadCount) {
+        tilesX = (width + tileSize - 1) / tileSize;
+        tilesY = (height + tileSize - 1) / tileSize;
+        // Rows are padded to whole tiles so vector stores never leave the row
+        stride = tilesX * tileSize;
+        color.assign(static_cast<size_t>(stride) * height, 0);
+        depth.assign(static_cast<size_t>(stride) * height, 1.0f);
+        chunks.resize(pool.size() * 4);
+        for (Chunk& chunk : chunks) chunk.bins.resize(static_cast<size_t>(tilesX) * tilesY);
+    }
+
+    int width() const { return framebufferWidth; }
+    int height() const { return framebufferHeight; }
+    unsigned threads() const { return pool.size(); }
+
+    // Clears color and depth when the next flush rasterizes its tiles
+    void clear(const glm::vec3& clearColor) {
+        auto channel = [](float value) { return static_cast<uint32_t>(std::lrint(std::min(std::max(value, 0.0f), 1.0f) * 255.0f)); };
+        clearValue = channel(clearColor.x) | channel(clearColor.y) << 8 | channel(clearColor.z) << 16 | 0xff000000u;
+        clearPending = true;
+    }
+
+    // Queues a Shape-layout mesh (float position + color, 32-bit indices). The shape
+    // must stay alive until flush.
+    void draw(const Shape& shape, const glm::mat4& mvp) {
+        commands.push_back({ &shape, mvp });
+    }
+
+    // Renders everything queued since the last flush
+    void flush() {
+        pool.run(chunks.size(), [this](size_t chunk, unsigned) { setupChunk(chunk); });
+        pool.run(static_cast<size_t>(tilesX) * tilesY, [this](size_t tile, unsigned) { rasterizeTile(tile); });
+        commands.clear();
+        clearPending = false;
+    }
+
+    // Triangles that reached the binning stage in the last flush
+    size_t triangleCount() const {
+        size_t count = 0;
+        for (const Chunk& chunk : chunks) count += chunk.triangles.size();
+        return count;
+    }
+
+    // Tightly packed RGB rows, top row first, like OffscreenTarget::readPixels
+    std::vector<unsigned char> readPixels() const {
+        std::vector<unsigned char> rgb(static_cast<size_t>(framebufferWidth) * framebufferHeight * 3);
+        for (int y = 0; y < framebufferHeight; ++y) {
+            const uint32_t* source = &color[static_cast<size_t>(framebufferHeight - 1 - y) * stride];
+            unsigned char* target = &rgb[static_cast<size_t>(y) * framebufferWidth * 3];
+            for (int x = 0; x < framebufferWidth; ++x) {
+                target[x * 3] = static_cast<unsigned char>(source[x]);
+                target[x * 3 + 1] = static_cast<unsigned char>(source[x] >> 8);
+                target[x * 3 + 2] = static_cast<unsigned char>(source[x] >> 16);
+            }
+        }
+        return rgb;
+    }
+
+private:
+    struct DrawCommand {
+        const Shape* shape;
+        glm::mat4 mvp;
+    };
+
+    struct ClipVertex {
+        glm::vec4 position;
+        glm::vec3 color;
+    };
+
+    // Screen-space triangle ready for rasterization. Positions are taken relative to
+    // the first vertex (origin), which keeps the plane constants small enough that
+    // depth on small, distant triangles is not lost to cancellation. Edge i is
+    // A*x + B*y + C >= threshold, with threshold 0 on top-left edges and the smallest
+    // positive float elsewhere. Planes give z, 1/w and color/w as dx * x + dy * y + c.
+    struct Triangle {
+        float originX, originY;
+        float edgeA[3], edgeB[3], edgeC[3], threshold[3];
+        float plane[5][3];
+        int minX, minY, maxX, maxY;
+    };
+
+    struct Chunk {
+        std::vector<Triangle> triangles;
+        std::vector<std::vector<uint32_t>> bins;
+    };
+
+    int framebufferWidth, framebufferHeight;
+    int tilesX = 0, tilesY = 0, stride = 0;
+    std::vector<uint32_t> color;
+    std::vector<float> depth;
+    uint32_t clearValue = 0xff000000u;
+    bool clearPending = false;
+    std::vector<DrawCommand> commands;
+    std::vector<Chunk> chunks;
+    WorkStealingPool pool;
+
+    void setupChunk(size_t index) {
+        Chunk& chunk = chunks[index];
+        chunk.triangles.clear();
+        for (std::vector<uint32_t>& bin : chunk.bins) bin.clear();
+
+        size_t perChunk = (commands.size() + chunks.size() - 1) / chunks.size();
+        size_t begin = std::min(commands.size(), index * perChunk), end = std::min(commands.size(), begin + perChunk);
+        std::vector<ClipVertex> vertices;
+        for (size_t c = begin; c < end; ++c) {
+            const Shape& shape = *commands[c].shape;
+            const glm::mat4& mvp = commands[c].mvp;
+            size_t vertexCount = shape.vertices.size() / 6;
+            vertices.resize(vertexCount);
+            for (size_t v = 0; v < vertexCount; ++v) {
+                const float* source = &shape.vertices[v * 6];
+                vertices[v].position = mvp * glm::vec4(source[0], source[1], source[2], 1.0f);
+                vertices[v].color = glm::vec3(source[3], source[4], source[5]);
+            }
+            for (size_t i = 0; i + 2 < shape.indices.size(); i += 3) {
+                clipAndSetup(chunk, vertices[shape.indices[i]], vertices[shape.indices[i + 1]], vertices[shape.indices[i + 2]]);
+            }
+        }
+    }
+
+    // Trivially rejects triangles outside one frustum plane and clips the rest against
+    // the near plane (z >= -w), which keeps w positive for the perspective divide
+    void clipAndSetup(Chunk& chunk, const ClipVertex& a, const ClipVertex& b, const ClipVertex& c) {
+        const ClipVertex* input[3] = { &a, &b, &c };
+        for (int axis = 0; axis < 3; ++axis) {
+            if (a.position[axis] > a.position.w && b.position[axis] > b.position.w && c.position[axis] > c.position.w) return;
+            if (a.position[axis] < -a.position.w && b.position[axis] < -b.position.w && c.position[axis] < -c.position.w) return;
+        }
+
+        ClipVertex clipped[4];
+        int count = 0;
+        for (int i = 0; i < 3; ++i) {
+            const ClipVertex& current = *input[i];
+            const ClipVertex& next = *input[(i + 1) % 3];
+            float currentDistance = current.position.z + current.position.w;
+            float nextDistance = next.position.z + next.position.w;
+            if (currentDistance >= 0.0f) clipped[count++] = current;
+            if ((currentDistance >= 0.0f) != (nextDistance >= 0.0f)) {
+                float t = currentDistance / (currentDistance - nextDistance);
+                clipped[count].position = current.position + (next.position - current.position) * t;
+                clipped[count].color = current.color + (next.color - current.color) * t;
+                ++count;
+            }
+        }
+        for (int i = 1; i + 1 < count; ++i) {
+            setupTriangle(chunk, clipped[0], clipped[i], clipped[i + 1]);
+        }
+    }
+
+    void setupTriangle(Chunk& chunk, const ClipVertex& a, const ClipVertex& b, const ClipVertex& c) {
+        const ClipVertex* vertex[3] = { &a, &b, &c };
+        float x[3], y[3], attribute[5][3];
+        for (int i = 0; i < 3; ++i) {
+            const glm::vec4& p = vertex[i]->position;
+            float inverseW = 1.0f / p.w;
+            // Window coordinates snapped to 8 subpixel bits, as llvmpipe and most GPUs do
+            x[i] = std::round(((p.x * inverseW) * 0.5f + 0.5f) * framebufferWidth * 256.0f) / 256.0f;
+            y[i] = std::round(((p.y * inverseW) * 0.5f + 0.5f) * framebufferHeight * 256.0f) / 256.0f;
+            attribute[0][i] = (p.z * inverseW) * 0.5f + 0.5f;
+            attribute[1][i] = inverseW;
+            attribute[2][i] = vertex[i]->color.x * inverseW;
+            attribute[3][i] = vertex[i]->color.y * inverseW;
+            attribute[4][i] = vertex[i]->color.z * inverseW;
+        }
+
+        float area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+        if (area == 0.0f) return;
+        // No face culling in the GL path either; clockwise triangles are turned around
+        if (area < 0.0f) {
+            std::swap(x[1], x[2]);
+            std::swap(y[1], y[2]);
+            for (float (&values)[3] : attribute) std::swap(values[1], values[2]);
+            area = -area;
+        }
+
+        Triangle triangle;
+        triangle.minX = std::max(0, static_cast<int>(std::ceil(std::min({ x[0], x[1], x[2] }) - 0.5f)));
+        triangle.maxX = std::min(framebufferWidth - 1, static_cast<int>(std::floor(std::max({ x[0], x[1], x[2] }) - 0.5f)));
+        triangle.minY = std::max(0, static_cast<int>(std::ceil(std::min({ y[0], y[1], y[2] }) - 0.5f)));
+        triangle.maxY = std::min(framebufferHeight - 1, static_cast<int>(std::floor(std::max({ y[0], y[1], y[2] }) - 0.5f)));
+        // Too small or off screen to cover a pixel center
+        if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY) return;
+
+        // Edge i runs from vertex i+1 to vertex i+2 and is zero on the opposite side of
+        // vertex i, so edge(i) / area is vertex i's barycentric weight
+        triangle.originX = x[0];
+        triangle.originY = y[0];
+        for (int i = 0; i < 3; ++i) {
+            int from = (i + 1) % 3, to = (i + 2) % 3;
+            float dx = x[to] - x[from], dy = y[to] - y[from];
+            triangle.edgeA[i] = -dy;
+            triangle.edgeB[i] = dx;
+            triangle.edgeC[i] = dy * (x[from] - x[0]) - dx * (y[from] - y[0]);
+            // Counter-clockwise with y up: left edges run downward, top edges run left
+            bool topLeft = dy < 0.0f || (dy == 0.0f && dx < 0.0f);
+            triangle.threshold[i] = topLeft ? 0.0f : std::numeric_limits<float>::denorm_min();
+        }
+        for (int a = 0; a < 5; ++a) {
+            float dx = 0.0f, dy = 0.0f;
+            for (int i = 0; i < 3; ++i) {
+                dx += triangle.edgeA[i] * attribute[a][i];
+                dy += triangle.edgeB[i] * attribute[a][i];
+            }
+            triangle.plane[a][0] = dx / area;
+            triangle.plane[a][1] = dy / area;
+            triangle.plane[a][2] = attribute[a][0];
+        }
+
+        uint32_t index = static_cast<uint32_t>(chunk.triangles.size());
+        chunk.triangles.push_back(triangle);
+        for (int tileY = triangle.minY / tileSize; tileY <= triangle.maxY / tileSize; ++tileY) {
+            for (int tileX = triangle.minX / tileSize; tileX <= triangle.maxX / tileSize; ++tileX) {
+                chunk.bins[static_cast<size_t>(tileY) * tilesX + tileX].push_back(index);
+            }
+        }
+    }
+
+    void rasterizeTile(size_t tile) {
+        int tileX0 = static_cast<int>(tile % tilesX) * tileSize, tileY0 = static_cast<int>(tile / tilesX) * tileSize;
+        int tileX1 = std::min(tileX0 + tileSize, framebufferWidth), tileY1 = std::min(tileY0 + tileSize, framebufferHeight);
+        if (clearPending) {
+            for (int y = tileY0; y < tileY1; ++y) {
+                std::fill_n(&color[static_cast<size_t>(y) * stride + tileX0], tileSize, clearValue);
+                std::fill_n(&depth[static_cast<size_t>(y) * stride + tileX0], tileSize, 1.0f);
+            }
+        }
+        for (const Chunk& chunk : chunks) {
+            for (uint32_t index : chunk.bins[tile]) {
+                rasterize<VectorLanes>(chunk.triangles[index], tileX0, tileY0, tileX1, tileY1);
+            }
+        }
+    }
+
+    template <class L>
+    void rasterize(const Triangle& t, int tileX0, int tileY0, int tileX1, int tileY1) {
+        typedef typename L::F F;
+        typedef typename L::M M;
+        int minY = std::max(t.minY, tileY0), maxY = std::min(t.maxY, tileY1 - 1);
+        int maxX = std::min(t.maxX, tileX1 - 1);
+        // Vectors start on a lane boundary inside the tile, so they never reach into a
+        // neighbouring tile that another thread is drawing
+        int startX = tileX0 + (std::max(t.minX, tileX0) - tileX0) / L::width * L::width;
+
+        const F lanes = L::ramp(), laneStep = L::set1(static_cast<float>(L::width));
+        F a[3], threshold[3];
+        for (int i = 0; i < 3; ++i) {
+            a[i] = L::set1(t.edgeA[i]);
+            threshold[i] = L::set1(t.threshold[i]);
+        }
+        F planeX[5];
+        for (int p = 0; p < 5; ++p) planeX[p] = L::set1(t.plane[p][0]);
+
+        for (int y = minY; y <= maxY; ++y) {
+            float centerY = y + 0.5f - t.originY;
+            F px = L::add(L::set1(startX + 0.5f - t.originX), lanes);
+            F edge[3], planeRow[5];
+            for (int i = 0; i < 3; ++i) edge[i] = L::add(L::mul(a[i], px), L::set1(t.edgeB[i] * centerY + t.edgeC[i]));
+            for (int p = 0; p < 5; ++p) planeRow[p] = L::set1(t.plane[p][1] * centerY + t.plane[p][2]);
+            F edgeStep[3] = { L::mul(a[0], laneStep), L::mul(a[1], laneStep), L::mul(a[2], laneStep) };
+
+            uint32_t* colorRow = &color[static_cast<size_t>(y) * stride];
+            float* depthRow = &depth[static_cast<size_t>(y) * stride];
+            for (int x = startX; x <= maxX; x += L::width) {
+                M inside = L::both(L::both(L::greaterEqual(edge[0], threshold[0]), L::greaterEqual(edge[1], threshold[1])),
+                    L::greaterEqual(edge[2], threshold[2]));
+                if (L::any(inside)) {
+                    F z = L::add(L::mul(planeX[0], px), planeRow[0]);
+                    F stored = L::load(depthRow + x);
+                    M pass = L::both(inside, L::less(z, stored));
+                    if (L::any(pass)) {
+                        L::store(depthRow + x, L::select(pass, z, stored));
+                        F w = L::div(L::set1(1.0f), L::add(L::mul(planeX[1], px), planeRow[1]));
+                        F r = L::mul(L::add(L::mul(planeX[2], px), planeRow[2]), w);
+                        F g = L::mul(L::add(L::mul(planeX[3], px), planeRow[3]), w);
+                        F b = L::mul(L::add(L::mul(planeX[4], px), planeRow[4]), w);
+                        L::storeColor(colorRow + x, pass, r, g, b);
+                    }
+                }
+                for (int i = 0; i < 3; ++i) edge[i] = L::add(edge[i], edgeStep[i]);
+                px = L::add(px, laneStep);
+            }
+        }
+    }
+};
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+public:
+    MappedFile() {}
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { close(); }
+
+    bool open(const std::string& path) {
+        close();
+#if defined(_WIN32)
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+            close();
+            return false;
+        }
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        if (!view) {
+            close();
+            return false;
+        }
+        bytes = static_cast<const char*>(view);
+        length = static_cast<size_t>(fileSize.QuadPart);
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        void* view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (view == MAP_FAILED) return false;
+        madvise(view, static_cast<size_t>(info.st_size), MADV_WILLNEED);
+        bytes = static_cast<const char*>(view);
+        length = static_cast<size_t>(info.st_size);
+#endif
+        return true;
+    }
+
+    void close() {
+#if defined(_WIN32)
+        if (bytes) UnmapViewOfFile(bytes);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (bytes) munmap(const_cast<char*>(bytes), length);
+#endif
+        bytes = nullptr;
+        length = 0;
+    }
+
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+    const char* bytes = nullptr;
+    size_t length = 0;
+#if defined(_WIN32)
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+};
+
+inline bool isDigit(char c) { return static_cast<unsigned>(c - '0') < 10; }
+inline bool isBlank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+// Decimal text to float without locale, errno or a terminating NUL. Up to 19 significant
+// digits are accumulated in an integer and scaled by one exact power of ten in double
+// precision; numbers outside that range go through strtod. Returns the position after
+// the number, or p itself when there is none.
+inline const char* parseFloat(const char* p, const char* end, float& out) {
+    static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+        1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+    const char* start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+
+    uint64_t mantissa = 0;
+    int digits = 0, exponent = 0;
+    bool any = false;
+    for (; p < end && isDigit(*p); ++p, any = true) {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (*p - '0');
+            digits += mantissa != 0;
+        }
+        else {
+            ++exponent;
+        }
+    }
+    if (p < end && *p == '.') {
+        for (++p; p < end && isDigit(*p); ++p, any = true) {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                digits += mantissa != 0;
+                --exponent;
+            }
+        }
+    }
+    if (!any) return start;
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char* e = p + 1;
+        bool negativeExponent = false;
+        if (e < end && (*e == '-' || *e == '+')) negativeExponent = *e++ == '-';
+        if (e < end && isDigit(*e)) {
+            int value = 0;
+            for (; e < end && isDigit(*e); ++e) value = std::min(value * 10 + (*e - '0'), 100000);
+            exponent += negativeExponent ? -value : value;
+            p = e;
+        }
+    }
+
+    if (exponent >= -22 && exponent <= 22 && mantissa < (uint64_t(1) << 53)) {
+        double value = exponent < 0 ? mantissa / powers[-exponent] : mantissa * powers[exponent];
+        out = static_cast<float>(negative ? -value : value);
+    }
+    else {
+        char buffer[64];
+        size_t length = std::min<size_t>(p - start, sizeof(buffer) - 1);
+        std::memcpy(buffer, start, length);
+        buffer[length] = '\0';
+        out = static_cast<float>(std::strtod(buffer, nullptr));
+    }
+    return p;
+}
+
+// What loadMesh() did and how long each stage took
+struct MeshLoadStats {
+    size_t bytes = 0;
+    size_t sourceVertices = 0; // as stored in the file
+    size_t vertices = 0;       // after welding
+    size_t triangles = 0;
+    bool colored = false;      // the file carried vertex colors
+    unsigned threads = 1;
+    double mapSeconds = 0.0, parseSeconds = 0.0, weldSeconds = 0.0;
+
+    double megabytesPerSecond() const { return parseSeconds > 0.0 ? bytes / 1048576.0 / parseSeconds : 0.0; }
+};
+
+// Splits [begin, end) into count pieces that each start at the beginning of a line
+std::vector<const char*> splitLines(const char* begin, const char* end, size_t count) {
+    std::vector<const char*> bounds(count + 1, end);
+    bounds[0] = begin;
+    for (size_t i = 1; i < count; ++i) {
+        const char* p = std::max(begin + (end - begin) * i / count, bounds[i - 1]);
+        const char* newline = p < end ? static_cast<const char*>(std::memchr(p, '\n', end - p)) : nullptr;
+        bounds[i] = newline ? newline + 1 : end;
+    }
+    return bounds;
+}
+
+// Wavefront OBJ: 'v x y z [r g b]' and 'f' lines with any number of corners in v, v/vt,
+// v//vn or v/vt/vn form, negative indices counting back from the current vertex. The
+// file is cut into line-aligned chunks that are counted in parallel, prefix sums give
+// every chunk its place in the preallocated arrays, and a second parallel pass parses
+// straight into them. Polygons are fanned into triangles; everything else is skipped.
+bool parseObj(const char* begin, const char* end, WorkStealingPool& pool, Shape& shape, bool& colored, std::string& error) {
+    struct Chunk {
+        size_t vertices = 0, triangles = 0;
+        size_t firstVertex = 0, firstTriangle = 0;
+        bool colored = false, badIndex = false;
+    };
+    std::vector<const char*> bounds = splitLines(begin, end, std::max<size_t>(1, std::min<size_t>(pool.size() * 4,
+        (end - begin) / 65536 + 1)));
+    std::vector<Chunk> chunks(bounds.size() - 1);
+
+    // Calls line(start, lineEnd) for every line of a chunk, leading blanks and any
+    // trailing # comment removed
+    auto forEachLine = [&](size_t c, auto&& line) {
+        for (const char* p = bounds[c]; p < bounds[c + 1];) {
+            const char* newline = static_cast<const char*>(std::memchr(p, '\n', bounds[c + 1] - p));
+            const char* next = newline ? newline + 1 : bounds[c + 1];
+            const char* lineEnd = newline ? newline : bounds[c + 1];
+            const char* comment = static_cast<const char*>(std::memchr(p, '#', lineEnd - p));
+            if (comment) lineEnd = comment;
+            while (p < lineEnd && isBlank(*p)) ++p;
+            if (lineEnd - p > 1 && isBlank(p[1])) line(p, lineEnd);
+            p = next;
+        }
+    };
+
+    pool.run(chunks.size(), [&](size_t c, unsigned) {
+        Chunk& chunk = chunks[c];
+        forEachLine(c, [&](const char* p, const char* lineEnd) {
+            if (*p == 'v') {
+                ++chunk.vertices;
+            }
+            else if (*p == 'f') {
+                size_t corners = 0;
+                for (++p; p < lineEnd;) {
+                    while (p < lineEnd && isBlank(*p)) ++p;
+                    if (p == lineEnd) break;
+                    ++corners;
+                    while (p < lineEnd && !isBlank(*p)) ++p;
+                }
+                chunk.triangles += corners > 2 ? corners - 2 : 0;
+            }
+        });
+    });
+
+    size_t vertexCount = 0, triangleCount = 0;
+    for (Chunk& chunk : chunks) {
+        chunk.firstVertex = vertexCount;
+        chunk.firstTriangle = triangleCount;
+        vertexCount += chunk.vertices;
+        triangleCount += chunk.triangles;
+    }
+    shape.vertices.resize(vertexCount * 6);
+    shape.indices.resize(triangleCount * 3);
+
+    pool.run(chunks.size(), [&](size_t c, unsigned) {
+        Chunk& chunk = chunks[c];
+        float* vertex = shape.vertices.data() + chunk.firstVertex * 6;
+        unsigned int* index = shape.indices.data() + chunk.firstTriangle * 3;
+        size_t verticesSoFar = chunk.firstVertex;
+        forEachLine(c, [&](const char* p, const char* lineEnd) {
+            if (*p == 'v') {
+                float values[6] = { 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f };
+                int read = 0;
+                for (++p; read < 6; ++read) {
+                    while (p < lineEnd && isBlank(*p)) ++p;
+                    const char* next = parseFloat(p, lineEnd, values[read]);
+                    if (next == p) break;
+                    p = next;
+                }
+                chunk.colored = chunk.colored || read == 6;
+                std::memcpy(vertex, values, sizeof(values));
+                vertex += 6;
+                ++verticesSoFar;
+            }
+            else if (*p == 'f') {
+                unsigned int first = 0, previous = 0;
+                int corner = 0;
+                for (++p; p < lineEnd; ++corner) {
+                    while (p < lineEnd && isBlank(*p)) ++p;
+                    if (p == lineEnd) break;
+                    bool negative = *p == '-';
+                    if (negative || *p == '+') ++p;
+                    long long value = 0;
+                    for (; p < lineEnd && isDigit(*p); ++p) value = value * 10 + (*p - '0');
+                    while (p < lineEnd && !isBlank(*p)) ++p; // texture and normal indices
+                    long long resolved = negative ? static_cast<long long>(verticesSoFar) - value : value - 1;
+                    if (value == 0 || resolved < 0 || resolved >= static_cast<long long>(vertexCount)) {
+                        chunk.badIndex = true;
+                        resolved = 0;
+                    }
+                    unsigned int current = static_cast<unsigned int>(resolved);
+                    if (corner == 0) first = current;
+                    if (corner >= 2) {
+                        index[0] = first;
+                        index[1] = previous;
+                        index[2] = current;
+                        index += 3;
+                    }
+                    previous = current;
+                }
+            }
+        });
+    });
+
+    colored = false;
+    for (const Chunk& chunk : chunks) {
+        if (chunk.badIndex) {
+            error = "face refers to a vertex that does not exist";
+            return false;
+        }
+        colored = colored || chunk.colored;
+    }
+    return true;
+}
+
+// Binary PLY, either byte order: a 'vertex' element with x, y, z and optionally red,
+// green, blue, and a 'face' element with a vertex_indices list. Vertices have a fixed
+// record size and are decoded in parallel ranges. Face records vary with their corner
+// counts, so one quick pass over the count fields finds where each parallel range
+// starts and how many triangles precede it. Elements other than those two may come
+// before or after them as long as their records have a fixed size.
+bool parsePly(const char* begin, const char* end, WorkStealingPool& pool, Shape& shape, bool& colored, std::string& error) {
+    enum Type { INT8, UINT8, INT16, UINT16, INT32, UINT32, FLOAT32, FLOAT64, UNKNOWN };
+    struct Property {
+        std::string name;
+        Type type = UNKNOWN, countType = UNKNOWN; // countType is set for lists
+        size_t offset = 0;
+    };
+    struct Element {
+        std::string name;
+        size_t count = 0;
+        std::vector<Property> properties;
+        size_t stride = 0; // fixed record size, or 0 when the record has a list
+    };
+    auto parseType = [](const std::string& name) {
+        static const char* names[][2] = { { "char", "int8" }, { "uchar", "uint8" }, { "short", "int16" }, { "ushort", "uint16" },
+            { "int", "int32" }, { "uint", "uint32" }, { "float", "float32" }, { "double", "float64" } };
+        for (int type = 0; type < UNKNOWN; ++type) {
+            if (name == names[type][0] || name == names[type][1]) return static_cast<Type>(type);
+        }
+        return UNKNOWN;
+    };
+    static const size_t typeSizes[] = { 1, 1, 2, 2, 4, 4, 4, 8 };
+
+    if (end - begin < 4 || std::memcmp(begin, "ply", 3) != 0 || !std::isspace(static_cast<unsigned char>(begin[3]))) {
+        error = "not a PLY file";
+        return false;
+    }
+    const char* headerEnd = nullptr;
+    for (const char* p = begin; p + 10 <= end && !headerEnd; ++p) {
+        if (std::memcmp(p, "end_header", 10) == 0 && (p == begin || p[-1] == '\n')) {
+            const char* newline = static_cast<const char*>(std::memchr(p, '\n', end - p));
+            headerEnd = newline ? newline + 1 : nullptr;
+        }
+    }
+    if (!headerEnd) {
+        error = "PLY header has no end_header";
+        return false;
+    }
+
+    std::istringstream header(std::string(begin, headerEnd));
+    std::vector<Element> elements;
+    bool bigEndian = false;
+    for (std::string line; std::getline(header, line);) {
+        std::istringstream words(line);
+        std::string keyword;
+        words >> keyword;
+        if (keyword == "format") {
+            std::string format;
+            words >> format;
+            if (format == "ascii") {
+                error = "ASCII PLY is not supported, only binary";
+                return false;
+            }
+            bigEndian = format == "binary_big_endian";
+        }
+        else if (keyword == "element") {
+            elements.push_back(Element());
+            words >> elements.back().name >> elements.back().count;
+        }
+        else if (keyword == "property" && !elements.empty()) {
+            Property property;
+            std::string type;
+            words >> type;
+            if (type == "list") {
+                std::string countType;
+                words >> countType >> type;
+                property.countType = parseType(countType);
+                if (property.countType == UNKNOWN) type.clear();
+            }
+            property.type = parseType(type);
+            words >> property.name;
+            if (property.type == UNKNOWN) {
+                error = "unknown PLY property type in '" + line + "'";
+                return false;
+            }
+            elements.back().properties.push_back(property);
+        }
+    }
+    for (Element& element : elements) {
+        size_t offset = 0;
+        for (Property& property : element.properties) {
+            property.offset = offset;
+            if (property.countType != UNKNOWN) {
+                offset = 0;
+                break;
+            }
+            offset += typeSizes[property.type];
+        }
+        element.stride = offset;
+    }
+
+    // Values are read through memcpy, so nothing needs to be aligned
+    auto read = [bigEndian](const char* p, Type type) -> double {
+        unsigned char bytes[8];
+        std::memcpy(bytes, p, typeSizes[type]);
+        if (bigEndian) std::reverse(bytes, bytes + typeSizes[type]);
+        switch (type) {
+        case INT8: { int8_t v; std::memcpy(&v, bytes, 1); return v; }
+        case UINT8: return bytes[0];
+        case INT16: { int16_t v; std::memcpy(&v, bytes, 2); return v; }
+        case UINT16: { uint16_t v; std::memcpy(&v, bytes, 2); return v; }
+        case INT32: { int32_t v; std::memcpy(&v, bytes, 4); return v; }
+        case UINT32: { uint32_t v; std::memcpy(&v, bytes, 4); return v; }
+        case FLOAT32: { float v; std::memcpy(&v, bytes, 4); return v; }
+        case FLOAT64: { double v; std::memcpy(&v, bytes, 8); return v; }
+        default: return 0.0;
+        }
+    };
+
+    const Element* vertexElement = nullptr;
+    const Element* faceElement = nullptr;
+    const char* vertexData = nullptr;
+    const char* faceData = nullptr;
+    const char* p = headerEnd;
+    for (const Element& element : elements) {
+        if (element.name == "vertex") {
+            vertexElement = &element;
+            vertexData = p;
+        }
+        else if (element.name == "face") {
+            faceElement = &element;
+            faceData = p;
+            break; // face records are walked below; nothing after them is needed
+        }
+        if (element.stride == 0 && element.count > 0) {
+            error = "PLY element '" + element.name + "' has a list and comes before the faces";
+            return false;
+        }
+        p += element.stride * element.count;
+    }
+    if (!vertexElement || p > end) {
+        error = "PLY file has no vertex element or is truncated";
+        return false;
+    }
+
+    int position[3] = { -1, -1, -1 }, color[3] = { -1, -1, -1 };
+    const char* positionNames[] = { "x", "y", "z" };
+    const char* colorNames[] = { "red", "green", "blue" };
+    for (size_t i = 0; i < vertexElement->properties.size(); ++i) {
+        for (int axis = 0; axis < 3; ++axis) {
+            if (vertexElement->properties[i].name == positionNames[axis]) position[axis] = static_cast<int>(i);
+            if (vertexElement->properties[i].name == colorNames[axis]) color[axis] = static_cast<int>(i);
+        }
+    }
+    if (position[0] < 0 || position[1] < 0 || position[2] < 0) {
+        error = "PLY vertices have no x, y and z";
+        return false;
+    }
+    colored = color[0] >= 0 && color[1] >= 0 && color[2] >= 0;
+
+    const size_t vertexCount = vertexElement->count;
+    const size_t rangeCount = pool.size() * 4;
+    shape.vertices.resize(vertexCount * 6);
+    pool.run(rangeCount, [&](size_t range, unsigned) {
+        for (size_t v = vertexCount * range / rangeCount; v < vertexCount * (range + 1) / rangeCount; ++v) {
+            const char* record = vertexData + v * vertexElement->stride;
+            float* out = &shape.vertices[v * 6];
+            for (int axis = 0; axis < 3; ++axis) {
+                const Property& property = vertexElement->properties[position[axis]];
+                out[axis] = static_cast<float>(read(record + property.offset, property.type));
+                out[3 + axis] = 1.0f;
+                if (colored) {
+                    const Property& channel = vertexElement->properties[color[axis]];
+                    double value = read(record + channel.offset, channel.type);
+                    out[3 + axis] = static_cast<float>(channel.type == FLOAT32 || channel.type == FLOAT64 ? value : value / 255.0);
+                }
+            }
+        }
+    });
+
+    if (!faceElement) {
+        shape.indices.clear();
+        return true;
+    }
+    int indexList = -1;
+    for (size_t i = 0; i < faceElement->properties.size(); ++i) {
+        const Property& property = faceElement->properties[i];
+        if (property.countType != UNKNOWN && (property.name == "vertex_indices" || property.name == "vertex_index")) {
+            indexList = static_cast<int>(i);
+        }
+    }
+    if (indexList < 0) {
+        error = "PLY faces have no vertex_indices list";
+        return false;
+    }
+
+    // Walks one face record, calling corners(listStart, count) for the index list
+    auto walkFace = [&](const char* record, auto&& corners) -> const char* {
+        for (size_t i = 0; i < faceElement->properties.size(); ++i) {
+            const Property& property = faceElement->properties[i];
+            if (static_cast<size_t>(end - record) < typeSizes[property.countType == UNKNOWN ? property.type : property.countType]) {
+                return nullptr;
+            }
+            if (property.countType == UNKNOWN) {
+                record += typeSizes[property.type];
+                continue;
+            }
+            size_t count = static_cast<size_t>(read(record, property.countType));
+            record += typeSizes[property.countType];
+            if (static_cast<size_t>(end - record) < count * typeSizes[property.type]) return nullptr;
+            if (static_cast<int>(i) == indexList) corners(record, count);
+            record += count * typeSizes[property.type];
+        }
+        return record;
+    };
+
+    // Sequential pass over the count fields: range starts and triangles before each
+    const size_t faceCount = faceElement->count;
+    std::vector<const char*> rangeStart(rangeCount);
+    std::vector<size_t> rangeTriangles(rangeCount + 1);
+    size_t triangles = 0;
+    const Type indexType = faceElement->properties[indexList].type;
+    auto countCorners = [&](const char*, size_t count) {
+        triangles += count > 2 ? count - 2 : 0;
+    };
+    const char* record = faceData;
+    for (size_t range = 0, face = 0; range < rangeCount; ++range) {
+        rangeStart[range] = record;
+        rangeTriangles[range] = triangles;
+        for (; face < faceCount * (range + 1) / rangeCount; ++face) {
+            record = walkFace(record, countCorners);
+            if (!record) {
+                error = "PLY face data is truncated";
+                return false;
+            }
+        }
+    }
+    rangeTriangles[rangeCount] = triangles;
+
+    shape.indices.resize(triangles * 3);
+    std::vector<unsigned char> badIndex(rangeCount, 0);
+    pool.run(rangeCount, [&](size_t range, unsigned) {
+        unsigned int* out = shape.indices.data() + rangeTriangles[range] * 3;
+        const char* cursor = rangeStart[range];
+        size_t faces = faceCount * (range + 1) / rangeCount - faceCount * range / rangeCount;
+        auto emit = [&](const char* list, size_t count) {
+            unsigned int first = 0, previous = 0;
+            for (size_t corner = 0; corner < count; ++corner) {
+                double value = read(list + corner * typeSizes[indexType], indexType);
+                if (value < 0.0 || value >= static_cast<double>(vertexCount)) {
+                    badIndex[range] = 1;
+                    value = 0.0;
+                }
+                unsigned int current = static_cast<unsigned int>(value);
+                if (corner == 0) first = current;
+                if (corner >= 2) {
+                    out[0] = first;
+                    out[1] = previous;
+                    out[2] = current;
+                    out += 3;
+                }
+                previous = current;
+            }
+        };
+        for (size_t face = 0; face < faces; ++face) cursor = walkFace(cursor, emit);
+    });
+    if (std::find(badIndex.begin(), badIndex.end(), 1) != badIndex.end()) {
+        error = "face refers to a vertex that does not exist";
+        return false;
+    }
+    return true;
+}
+
+// Welds vertices with bit-identical position and color. Each vertex's hash picks one of
+// a power-of-two number of partitions; vertices are scattered into their partitions in
+// index order, and every partition is deduplicated through its own open-addressing table
+// on one task. The first occurrence of a vertex is the one kept, so the result is the
+// same as a sequential weld whatever the thread count.
+void weldVertices(Shape& shape, WorkStealingPool& pool) {
+    const size_t vertexCount = shape.vertices.size() / 6;
+    const size_t blockCount = pool.size() * 4;
+    const unsigned partitionBits = 6;
+    const size_t partitionCount = size_t(1) << partitionBits;
+    const uint32_t empty = 0xffffffffu;
+    auto blockBegin = [&](size_t block) { return vertexCount * block / blockCount; };
+    auto sameVertex = [&](size_t a, size_t b) {
+        return std::memcmp(&shape.vertices[a * 6], &shape.vertices[b * 6], 6 * sizeof(float)) == 0;
+    };
+
+    std::vector<uint64_t> hashes(vertexCount);
+    std::vector<size_t> counts(blockCount * partitionCount, 0);
+    pool.run(blockCount, [&](size_t block, unsigned) {
+        for (size_t v = blockBegin(block); v < blockBegin(block + 1); ++v) {
+            uint64_t hash = 0x9e3779b97f4a7c15ull;
+            uint32_t words[6];
+            std::memcpy(words, &shape.vertices[v * 6], sizeof(words));
+            for (uint32_t word : words) {
+                hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+                hash ^= hash >> 32;
+            }
+            hashes[v] = hash;
+            ++counts[block * partitionCount + (hash >> (64 - partitionBits))];
+        }
+    });
+
+    // Partition-major offsets keep each partition's vertices in index order
+    std::vector<size_t> offsets(blockCount * partitionCount), partitionStart(partitionCount + 1);
+    size_t total = 0;
+    for (size_t partition = 0; partition < partitionCount; ++partition) {
+        partitionStart[partition] = total;
+        for (size_t block = 0; block < blockCount; ++block) {
+            offsets[block * partitionCount + partition] = total;
+            total += counts[block * partitionCount + partition];
+        }
+    }
+    partitionStart[partitionCount] = total;
+    std::vector<uint32_t> order(vertexCount);
+    pool.run(blockCount, [&](size_t block, unsigned) {
+        size_t* next = &offsets[block * partitionCount];
+        for (size_t v = blockBegin(block); v < blockBegin(block + 1); ++v) {
+            order[next[hashes[v] >> (64 - partitionBits)]++] = static_cast<uint32_t>(v);
+        }
+    });
+
+    std::vector<uint32_t> remap(vertexCount);
+    pool.run(partitionCount, [&](size_t partition, unsigned) {
+        size_t size = partitionStart[partition + 1] - partitionStart[partition];
+        size_t capacity = 16;
+        while (capacity < size * 2) capacity *= 2;
+        std::vector<uint32_t> table(capacity, empty);
+        for (size_t i = partitionStart[partition]; i < partitionStart[partition + 1]; ++i) {
+            uint32_t v = order[i];
+            for (size_t slot = hashes[v] & (capacity - 1);; slot = (slot + 1) & (capacity - 1)) {
+                if (table[slot] == empty) {
+                    table[slot] = v;
+                    remap[v] = v;
+                    break;
+                }
+                if (hashes[table[slot]] == hashes[v] && sameVertex(table[slot], v)) {
+                    remap[v] = table[slot];
+                    break;
+                }
+            }
+        }
+    });
+
+    // Kept vertices are renumbered in order through per-block prefix counts
+    std::vector<size_t> kept(blockCount + 1, 0);
+    pool.run(blockCount, [&](size_t block, unsigned) {
+        for (size_t v = blockBegin(block); v < blockBegin(block + 1); ++v) kept[block + 1] += remap[v] == v;
+    });
+    for (size_t block = 0; block < blockCount; ++block) kept[block + 1] += kept[block];
+    if (kept[blockCount] == vertexCount) return;
+
+    std::vector<uint32_t> renumber(vertexCount);
+    std::vector<float> welded(kept[blockCount] * 6);
+    pool.run(blockCount, [&](size_t block, unsigned) {
+        size_t next = kept[block];
+        for (size_t v = blockBegin(block); v < blockBegin(block + 1); ++v) {
+            if (remap[v] != v) continue;
+            renumber[v] = static_cast<uint32_t>(next);
+            std::memcpy(&welded[next * 6], &shape.vertices[v * 6], 6 * sizeof(float));
+            ++next;
+        }
+    });
+    const size_t indexCount = shape.indices.size();
+    pool.run(blockCount, [&](size_t block, unsigned) {
+        for (size_t i = indexCount * block / blockCount; i < indexCount * (block + 1) / blockCount; ++i) {
+            shape.indices[i] = renumber[remap[shape.indices[i]]];
+        }
+    });
+    shape.vertices.swap(welded);
+}
+
+// Loads an .obj or binary .ply file into shape on threadCount threads (0 = all cores),
+// welding duplicate vertices. Vertices without colors in the file are white.
+bool loadMesh(const std::string& path, Shape& shape, MeshLoadStats& stats, std::string& error, unsigned threadCount = 0) {
+    typedef std::chrono::steady_clock Clock;
+    std::string extension = path.size() >= 4 ? path.substr(path.size() - 4) : "";
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return static_cast<char>(std::tolower(c)); });
+    if (extension != ".obj" && extension != ".ply") {
+        error = "unsupported mesh format (expected .obj or .ply)";
+        return false;
+    }
+
+    Clock::time_point start = Clock::now();
+    MappedFile file;
+    if (!file.open(path)) {
+        error = "cannot open or map " + path;
+        return false;
+    }
+    Clock::time_point mapped = Clock::now();
+
+    WorkStealingPool pool(threadCount ? threadCount : std::max(1u, std::thread::hardware_concurrency()));
+    stats = MeshLoadStats();
+    stats.bytes = file.size();
+    stats.threads = pool.size();
+    bool parsed = extension == ".obj" ? parseObj(file.data(), file.data() + file.size(), pool, shape, stats.colored, error)
+        : parsePly(file.data(), file.data() + file.size(), pool, shape, stats.colored, error);
+    if (!parsed) return false;
+    Clock::time_point parseEnd = Clock::now();
+
+    stats.sourceVertices = shape.vertices.size() / 6;
+    weldVertices(shape, pool);
+    stats.vertices = shape.vertices.size() / 6;
+    stats.triangles = shape.indices.size() / 3;
+    stats.mapSeconds = std::chrono::duration<double>(mapped - start).count();
+    stats.parseSeconds = std::chrono::duration<double>(parseEnd - mapped).count();
+    stats.weldSeconds = std::chrono::duration<double>(Clock::now() - parseEnd).count();
+    return true;
+}
+
+void printMeshLoadStats(std::ostream& out, const std::string& path, const MeshLoadStats& stats) {
+    out << path << ": " << stats.bytes / 1048576.0 << " MB, " << stats.triangles << " triangles, " << stats.sourceVertices
+        << " vertices welded to " << stats.vertices << (stats.colored ? ", colored" : "") << std::endl;
+    out << "  map " << stats.mapSeconds * 1000.0 << " ms, parse " << stats.parseSeconds * 1000.0 << " ms ("
+        << stats.megabytesPerSecond() << " MB/s), weld " << stats.weldSeconds * 1000.0 << " ms on " << stats.threads
+        << " threads" << std::endl;
+}
+
+// Post-transform vertex cache statistics of an index buffer. ACMR is vertex shader runs
+// per triangle (0.5 is the ideal for large regular meshes, 3 the worst), ATVR runs per
+// distinct vertex (1 is ideal). The cache is modelled as a FIFO of cacheSize vertices.
+// Overfetch is vertex bytes read through a 16 KB direct-mapped cache of 64-byte lines,
+// relative to the size of the vertex buffer, for a stride of sizeof(PreciseVertex).
+struct VertexCacheStats {
+    double acmr = 0.0, atvr = 0.0, overfetch = 0.0;
+};
+
+VertexCacheStats analyzeVertexCache(const std::vector<unsigned int>& indices, size_t vertexCount, unsigned cacheSize = 16) {
+    VertexCacheStats stats;
+    if (indices.empty() || vertexCount == 0) return stats;
+    // Timestamps instead of a queue: a vertex is cached if it entered within the last
+    // cacheSize misses
+    std::vector<size_t> entered(vertexCount, 0);
+    std::vector<size_t> lines(256, SIZE_MAX);
+    size_t misses = 0, fetchedLines = 0, used = 0;
+    std::vector<unsigned char> seen(vertexCount, 0);
+    for (unsigned int index : indices) {
+        used += !seen[index];
+        seen[index] = 1;
+        if (entered[index] && misses - entered[index] < cacheSize) continue;
+        entered[index] = ++misses;
+        size_t first = index * sizeof(PreciseVertex) / 64, last = ((index + 1) * sizeof(PreciseVertex) - 1) / 64;
+        for (size_t line = first; line <= last; ++line) {
+            if (lines[line % lines.size()] != line) {
+                lines[line % lines.size()] = line;
+                ++fetchedLines;
+            }
+        }
+    }
+    stats.acmr = static_cast<double>(misses) / (indices.size() / 3);
+    stats.atvr = static_cast<double>(misses) / std::max<size_t>(used, 1);
+    stats.overfetch = static_cast<double>(fetchedLines * 64) / (vertexCount * sizeof(PreciseVertex));
+    return stats;
+}
+
+// Reorders triangles for the post-transform cache with Forsyth's linear-speed algorithm:
+// vertices score by their position in a simulated 32-entry LRU cache and by how few
+// triangles still use them, and the next triangle is the best scoring one touching the
+// cache. When no cached vertex has triangles left the next unused triangle in the
+// original order is taken, which keeps the pass O(triangles).
+void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount) {
+    const int cacheSize = 32;
+    const size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) return;
+
+    // Triangles of each vertex; live[v] counts the ones not yet emitted, which are kept
+    // at the front of the vertex's range
+    std::vector<unsigned int> live(vertexCount, 0), first(vertexCount + 1, 0);
+    for (unsigned int index : indices) ++live[index];
+    for (size_t v = 0; v < vertexCount; ++v) first[v + 1] = first[v] + live[v];
+    std::vector<unsigned int> adjacency(indices.size()), fill(first.begin(), first.end() - 1);
+    for (size_t t = 0; t < triangleCount; ++t) {
+        for (int corner = 0; corner < 3; ++corner) adjacency[fill[indices[t * 3 + corner]]++] = static_cast<unsigned int>(t);
+    }
+
+    // Static initialization runs once even when meshes are optimized on several threads
+    static const std::array<float, cacheSize> positionScores = []() {
+        std::array<float, cacheSize> table;
+        for (int p = 0; p < cacheSize; ++p) {
+            table[p] = p < 3 ? 0.75f : std::pow(1.0f - (p - 3) / float(cacheSize - 3), 1.5f);
+        }
+        return table;
+    }();
+    static const std::array<float, 64> valenceScores = []() {
+        std::array<float, 64> table = {};
+        for (int count = 1; count < 64; ++count) table[count] = 2.0f / std::sqrt(static_cast<float>(count));
+        return table;
+    }();
+    std::vector<int> cachePosition(vertexCount, -1);
+    auto vertexScore = [&](unsigned int v) {
+        if (live[v] == 0) return -1.0f;
+        float score = cachePosition[v] >= 0 ? positionScores[cachePosition[v]] : 0.0f;
+        return score + (live[v] < 64 ? valenceScores[live[v]] : 2.0f / std::sqrt(static_cast<float>(live[v])));
+    };
+    std::vector<float> scores(vertexCount), triangleScores(triangleCount);
+    for (size_t v = 0; v < vertexCount; ++v) scores[v] = vertexScore(static_cast<unsigned int>(v));
+    for (size_t t = 0; t < triangleCount; ++t) {
+        triangleScores[t] = scores[indices[t * 3]] + scores[indices[t * 3 + 1]] + scores[indices[t * 3 + 2]];
+    }
+
+    std::vector<unsigned char> emitted(triangleCount, 0);
+    std::vector<unsigned int> output(indices.size());
+    unsigned int cache[cacheSize + 3], nextCache[cacheSize + 3];
+    int cacheCount = 0;
+    size_t scan = 0;
+    long long best = -1;
+    for (size_t written = 0; written < triangleCount; ++written) {
+        if (best < 0) {
+            while (emitted[scan]) ++scan;
+            best = static_cast<long long>(scan);
+        }
+        size_t t = static_cast<size_t>(best);
+        emitted[t] = 1;
+        const unsigned int* corners = &indices[t * 3];
+        std::copy(corners, corners + 3, &output[written * 3]);
+
+        // Drop the triangle from its vertices' live ranges
+        for (int corner = 0; corner < 3; ++corner) {
+            unsigned int v = corners[corner];
+            unsigned int* range = &adjacency[first[v]];
+            for (unsigned int i = 0; i < live[v]; ++i) {
+                if (range[i] == t) {
+                    std::swap(range[i], range[live[v] - 1]);
+                    break;
+                }
+            }
+            --live[v];
+        }
+
+        // Move the triangle's vertices to the front of the LRU cache
+        int nextCount = 0;
+        for (int corner = 0; corner < 3; ++corner) {
+            if (corner == 0 || (corners[corner] != corners[0] && (corner == 1 || corners[2] != corners[1]))) {
+                nextCache[nextCount++] = corners[corner];
+            }
+        }
+        for (int i = 0; i < cacheCount; ++i) {
+            unsigned int v = cache[i];
+            if (v != corners[0] && v != corners[1] && v != corners[2]) nextCache[nextCount++] = v;
+        }
+        for (int i = cacheSize; i < nextCount; ++i) cachePosition[nextCache[i]] = -1;
+        cacheCount = std::min(nextCount, cacheSize);
+        std::copy(nextCache, nextCache + nextCount, cache);
+
+        // Rescore the cached vertices and their remaining triangles, remembering the best
+        for (int i = 0; i < cacheCount; ++i) cachePosition[cache[i]] = i;
+        for (int i = 0; i < nextCount; ++i) {
+            unsigned int v = cache[i];
+            if (i >= cacheSize) cachePosition[v] = -1;
+            float delta = vertexScore(v) - scores[v];
+            scores[v] += delta;
+            for (unsigned int j = 0; j < live[v]; ++j) triangleScores[adjacency[first[v] + j]] += delta;
+        }
+        best = -1;
+        float bestScore = 0.0f;
+        for (int i = 0; i < cacheCount; ++i) {
+            unsigned int v = cache[i];
+            for (unsigned int j = 0; j < live[v]; ++j) {
+                unsigned int candidate = adjacency[first[v] + j];
+                if (triangleScores[candidate] > bestScore) {
+                    bestScore = triangleScores[candidate];
+                    best = candidate;
+                }
+            }
+        }
+    }
+    indices.swap(output);
+}
+
+// Reduces overdraw without giving back much of the vertex cache order, after Sander et
+// al.'s "Fast triangle reordering for vertex locality and reduced overdraw". The cache
+// optimized sequence is cut into clusters wherever the cache restarts, and long clusters
+// again wherever the running ACMR is within threshold of the cluster's own. Clusters are
+// then drawn outermost first: sorted by how far their centroid lies along their average
+// normal from the mesh centroid, so front-facing outer surfaces tend to fill the depth
+// buffer before what they hide. This only pays off with back faces culled, which the
+// renderers here do not do, so optimizeMesh() runs it on request.
+void optimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<float>& vertices, float threshold = 1.05f) {
+    const size_t triangleCount = indices.size() / 3;
+    const unsigned cacheSize = 16;
+    if (triangleCount < 2) return;
+    auto position = [&](unsigned int v) { return glm::vec3(vertices[v * 6], vertices[v * 6 + 1], vertices[v * 6 + 2]); };
+
+    // Hard boundaries: triangles whose three vertices all miss the cache
+    std::vector<size_t> entered(vertices.size() / 6, 0);
+    std::vector<size_t> clusters;
+    std::vector<unsigned char> triangleMisses(triangleCount);
+    size_t misses = 0;
+    for (size_t t = 0; t < triangleCount; ++t) {
+        unsigned char missed = 0;
+        for (int corner = 0; corner < 3; ++corner) {
+            unsigned int v = indices[t * 3 + corner];
+            if (entered[v] && misses - entered[v] < cacheSize) continue;
+            entered[v] = ++misses;
+            ++missed;
+        }
+        triangleMisses[t] = missed;
+        if (missed == 3) clusters.push_back(t);
+    }
+    if (clusters.empty() || clusters[0] != 0) clusters.insert(clusters.begin(), 0);
+    clusters.push_back(triangleCount);
+
+    // Soft boundaries inside each cluster: a run may end once its ACMR, simulated from an
+    // empty cache, has come down to within threshold of the cluster's
+    std::vector<size_t> starts;
+    for (size_t c = 0; c + 1 < clusters.size(); ++c) {
+        size_t begin = clusters[c], end = clusters[c + 1], clusterMisses = 0;
+        for (size_t t = begin; t < end; ++t) clusterMisses += triangleMisses[t];
+        double clusterAcmr = static_cast<double>(clusterMisses) / (end - begin);
+        starts.push_back(begin);
+        size_t runMisses = 0, runStart = begin, runBase = misses;
+        for (size_t t = begin; t < end; ++t) {
+            for (int corner = 0; corner < 3; ++corner) {
+                unsigned int v = indices[t * 3 + corner];
+                if (entered[v] > runBase && misses - entered[v] < cacheSize) continue;
+                entered[v] = ++misses;
+                ++runMisses;
+            }
+            if (t + 1 < end && runMisses <= clusterAcmr * threshold * (t + 1 - runStart)) {
+                starts.push_back(t + 1);
+                runStart = t + 1;
+                runMisses = 0;
+                runBase = misses;
+            }
+        }
+    }
+    starts.push_back(triangleCount);
+
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    std::vector<std::pair<float, size_t>> order(starts.size() - 1);
+    std::vector<glm::vec3> centroids(order.size()), normals(order.size());
+    for (size_t c = 0; c + 1 < starts.size(); ++c) {
+        glm::vec3 centroid(0.0f), normal(0.0f);
+        float area = 0.0f;
+        for (size_t t = starts[c]; t < starts[c + 1]; ++t) {
+            glm::vec3 a = position(indices[t * 3]), b = position(indices[t * 3 + 1]), d = position(indices[t * 3 + 2]);
+            glm::vec3 weightedNormal = glm::cross(b - a, d - a);
+            float triangleArea = glm::length(weightedNormal);
+            centroid += (a + b + d) * (triangleArea / 3.0f);
+            normal += weightedNormal;
+            area += triangleArea;
+        }
+        meshCentroid += centroid;
+        meshArea += area;
+        centroids[c] = area > 0.0f ? centroid / area : position(indices[starts[c] * 3]);
+        float length = glm::length(normal);
+        normals[c] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+    }
+    meshCentroid = meshArea > 0.0f ? meshCentroid / meshArea : glm::vec3(0.0f);
+    for (size_t c = 0; c < order.size(); ++c) order[c] = std::make_pair(-glm::dot(centroids[c] - meshCentroid, normals[c]), c);
+    std::stable_sort(order.begin(), order.end(), [](const std::pair<float, size_t>& a, const std::pair<float, size_t>& b) {
+        return a.first < b.first;
+    });
+
+    std::vector<unsigned int> output;
+    output.reserve(indices.size());
+    for (const std::pair<float, size_t>& entry : order) {
+        output.insert(output.end(), indices.begin() + starts[entry.second] * 3, indices.begin() + starts[entry.second + 1] * 3);
+    }
+    indices.swap(output);
+}
+
+// Renumbers vertices in order of first use by the index buffer, so vertex fetches walk
+// the buffer roughly forwards. Vertices no triangle uses are dropped.
+void optimizeVertexFetch(Shape& shape) {
+    const uint32_t unused = 0xffffffffu;
+    std::vector<uint32_t> remap(shape.vertices.size() / 6, unused);
+    std::vector<float> vertices;
+    vertices.reserve(shape.vertices.size());
+    uint32_t next = 0;
+    for (unsigned int& index : shape.indices) {
+        if (remap[index] == unused) {
+            remap[index] = next++;
+            vertices.insert(vertices.end(), shape.vertices.begin() + index * 6, shape.vertices.begin() + index * 6 + 6);
+        }
+        index = remap[index];
+    }
+    shape.vertices.swap(vertices);
+}
+
+// A run of at most maxTriangles consecutive triangles using at most maxVertices distinct
+// vertices, with bounds for culling whole runs: a bounding sphere and a normal cone. The
+// run faces away from a camera at eye, and can be skipped, when
+//   dot(center - eye, coneAxis) >= coneCutoff * length(center - eye) + radius
+// coneCutoff is 1 when the normals spread too far for the test to ever pass.
+struct Meshlet {
+    size_t firstIndex = 0;
+    size_t indexCount = 0;
+    unsigned vertexCount = 0;
+    glm::vec3 center{ 0.0f };
+    float radius = 0.0f;
+    glm::vec3 coneAxis{ 0.0f, 0.0f, 1.0f };
+    float coneCutoff = 1.0f;
+};
+
+// Splits the index buffer, in its current order, into meshlets
+std::vector<Meshlet> buildMeshlets(const Shape& shape, unsigned maxVertices = 64, unsigned maxTriangles = 124) {
+    std::vector<Meshlet> meshlets;
+    std::vector<size_t> lastMeshlet(shape.vertices.size() / 6, SIZE_MAX);
+    auto position = [&](unsigned int v) {
+        return glm::vec3(shape.vertices[v * 6], shape.vertices[v * 6 + 1], shape.vertices[v * 6 + 2]);
+    };
+
+    auto finish = [&](Meshlet& meshlet) {
+        glm::vec3 low(FLT_MAX), high(-FLT_MAX), axis(0.0f);
+        size_t end = meshlet.firstIndex + meshlet.indexCount;
+        for (size_t i = meshlet.firstIndex; i < end; ++i) {
+            low = glm::min(low, position(shape.indices[i]));
+            high = glm::max(high, position(shape.indices[i]));
+        }
+        meshlet.center = (low + high) * 0.5f;
+        for (size_t i = meshlet.firstIndex; i < end; ++i) {
+            meshlet.radius = std::max(meshlet.radius, glm::length(position(shape.indices[i]) - meshlet.center));
+        }
+        std::vector<glm::vec3> normals;
+        for (size_t i = meshlet.firstIndex; i < end; i += 3) {
+            glm::vec3 a = position(shape.indices[i]);
+            glm::vec3 normal = glm::cross(position(shape.indices[i + 1]) - a, position(shape.indices[i + 2]) - a);
+            float length = glm::length(normal);
+            if (length > 0.0f) normals.push_back(normal / length);
+        }
+        for (const glm::vec3& normal : normals) axis += normal;
+        float axisLength = glm::length(axis);
+        if (normals.empty() || axisLength == 0.0f) return;
+        meshlet.coneAxis = axis / axisLength;
+        float minimumDot = 1.0f;
+        for (const glm::vec3& normal : normals) minimumDot = std::min(minimumDot, glm::dot(normal, meshlet.coneAxis));
+        meshlet.coneCutoff = minimumDot <= 0.1f ? 1.0f : std::sqrt(1.0f - minimumDot * minimumDot);
+    };
+
+    Meshlet current;
+    for (size_t i = 0; i < shape.indices.size(); i += 3) {
+        unsigned added = 0;
+        for (int corner = 0; corner < 3; ++corner) {
+            unsigned int v = shape.indices[i + corner];
+            added += lastMeshlet[v] != meshlets.size() && (corner == 0 || v != shape.indices[i]) &&
+                (corner < 2 || v != shape.indices[i + 1]);
+        }
+        if (current.indexCount > 0 && (current.vertexCount + added > maxVertices || current.indexCount / 3 == maxTriangles)) {
+            finish(current);
+            meshlets.push_back(current);
+            current = Meshlet();
+            current.firstIndex = i;
+            i -= 3; // the triangle starts the next meshlet
+            continue;
+        }
+        for (int corner = 0; corner < 3; ++corner) lastMeshlet[shape.indices[i + corner]] = meshlets.size();
+        current.vertexCount += added;
+        current.indexCount += 3;
+    }
+    if (current.indexCount > 0) {
+        finish(current);
+        meshlets.push_back(current);
+    }
+    return meshlets;
+}
+
+// Before/after figures of optimizeMesh()
+struct MeshOptimizeStats {
+    VertexCacheStats before, after;
+    size_t meshlets = 0;
+    double meshletVertices = 0.0, meshletTriangles = 0.0; // averages
+    double cacheSeconds = 0.0, overdrawSeconds = 0.0, fetchSeconds = 0.0, meshletSeconds = 0.0;
+};
+
+// Optimization stage for meshes on their way into the geometry pool: triangle order for
+// the vertex cache, optionally for overdraw, then vertex order for fetch locality, and
+// meshlets over the final order when meshlets is given
+void optimizeMesh(Shape& shape, MeshOptimizeStats& stats, std::vector<Meshlet>* meshlets = nullptr, bool overdraw = false) {
+    typedef std::chrono::steady_clock Clock;
+    auto seconds = [](Clock::time_point start) { return std::chrono::duration<double>(Clock::now() - start).count(); };
+    stats = MeshOptimizeStats();
+    stats.before = analyzeVertexCache(shape.indices, shape.vertices.size() / 6);
+
+    Clock::time_point start = Clock::now();
+    optimizeVertexCache(shape.indices, shape.vertices.size() / 6);
+    stats.cacheSeconds = seconds(start);
+    if (overdraw) {
+        start = Clock::now();
+        optimizeOverdraw(shape.indices, shape.vertices);
+        stats.overdrawSeconds = seconds(start);
+    }
+    start = Clock::now();
+    optimizeVertexFetch(shape);
+    stats.fetchSeconds = seconds(start);
+    stats.after = analyzeVertexCache(shape.indices, shape.vertices.size() / 6);
+
+    if (meshlets) {
+        start = Clock::now();
+        *meshlets = buildMeshlets(shape);
+        stats.meshletSeconds = seconds(start);
+        stats.meshlets = meshlets->size();
+        for (const Meshlet& meshlet : *meshlets) {
+            stats.meshletVertices += meshlet.vertexCount;
+            stats.meshletTriangles += meshlet.indexCount / 3;
+        }
+        if (!meshlets->empty()) {
+            stats.meshletVertices /= meshlets->size();
+            stats.meshletTriangles /= meshlets->size();
+        }
+    }
+}
+
+void printMeshOptimizeStats(std::ostream& out, const MeshOptimizeStats& stats) {
+    out << "  vertex cache: ACMR " << stats.before.acmr << " -> " << stats.after.acmr << ", ATVR " << stats.before.atvr
+        << " -> " << stats.after.atvr << ", overfetch " << stats.before.overfetch << " -> " << stats.after.overfetch << std::endl;
+    out << "  optimized in " << (stats.cacheSeconds + stats.overdrawSeconds + stats.fetchSeconds) * 1000.0 << " ms (cache "
+        << stats.cacheSeconds * 1000.0;
+    if (stats.overdrawSeconds > 0.0) out << ", overdraw " << stats.overdrawSeconds * 1000.0;
+    out << ", fetch " << stats.fetchSeconds * 1000.0 << ")" << std::endl;
+    if (stats.meshlets > 0) {
+        out << "  " << stats.meshlets << " meshlets, " << stats.meshletVertices << " vertices and " << stats.meshletTriangles
+            << " triangles on average, built in " << stats.meshletSeconds * 1000.0 << " ms" << std::endl;
+    }
+}
+
+// Loads a mesh on one thread and on threadCount threads (0 = all cores), reports both
+// and checks that they produced the same mesh, then reports what optimizeMesh() does to
+// it. Returns 1 on a load error or mismatch.
+int runMeshBenchmark(const std::string& path, unsigned threadCount) {
+    Shape reference, parallel;
+    MeshLoadStats stats;
+    std::string error;
+    if (!loadMesh(path, reference, stats, error, 1)) {
+        std::cerr << "Could not load " << path << ": " << error << std::endl;
+        return 1;
+    }
+    printMeshLoadStats(std::cout, path, stats);
+    loadMesh(path, parallel, stats, error, threadCount);
+    printMeshLoadStats(std::cout, path, stats);
+    bool same = reference.vertices == parallel.vertices && reference.indices == parallel.indices;
+    std::cout << (same ? "Parallel load matches the single-threaded one" : "Parallel load DIFFERS from the single-threaded one")
+        << std::endl;
+    MeshOptimizeStats optimizeStats;
+    std::vector<Meshlet> meshlets;
+    optimizeMesh(parallel, optimizeStats, &meshlets);
+    printMeshOptimizeStats(std::cout, optimizeStats);
+    return same ? 0 : 1;
+}
+
+// Renders the scene a fixed number of frames per draw path in the current context and
+// reports instances per second, matrix rebuilds included
+void runSceneBenchmark(ProgramCache& programCache, GeometryPool& geometry, size_t count) {
+    typedef std::chrono::steady_clock Clock;
+    InstancedScene scene(programCache, geometry);
+    scene.populate(count);
+
+    const float distance = scene.viewDistance();
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, distance * 0.3f, distance), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, distance * 4.0f);
+
+    std::cout << "Scene benchmark: " << scene.size() << " instances" << std::endl;
+
+    Clock::time_point start = Clock::now();
+    const int matrixFrames = 10;
+    for (int frame = 0; frame < matrixFrames; ++frame) {
+        scene.buildMatrices();
+    }
+    double matrixSeconds = std::chrono::duration<double>(Clock::now() - start).count() / matrixFrames;
+    std::cout << "  matrix build  " << matrixSeconds * 1000.0 << " ms/frame, "
+        << scene.size() / matrixSeconds / 1e6 << " M matrices/s" << std::endl;
+
+    for (int path = 0; path < 2; ++path) {
+        const int frames = 10;
+        auto draw = [&]() {
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            scene.update(1.0f / 60.0f);
+            if (path == 0) scene.render(view, projection);
+            else scene.renderPerObject(view, projection);
+        };
+        draw();
+        glFinish();
+
+        start = Clock::now();
+        for (int frame = 0; frame < frames; ++frame) {
+            draw();
+        }
+        glFinish();
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count() / frames;
+        geometry.beginFrame();
+        draw();
+        GeometryPool::FrameStats stats = geometry.beginFrame();
+        std::cout << "  " << (path == 0 ? "instanced     " : "per object    ") << seconds * 1000.0 << " ms/frame, "
+            << scene.size() / seconds / 1e6 << " M instances/s, " << stats.draws << " draws, " << stats.binds
+            << " vertex array binds" << std::endl;
+    }
+    scene.cleanup();
+}
+
+// GL 3.3 core context without a window, for CI and batch nodes without a display.
+// Rendering goes to an FBO, so the context itself needs no surface.
+class HeadlessContext {
+public:
+    bool create(std::string& error) {
+#if defined(HEADLESS_EGL)
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        display = getPlatformDisplay ? getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL)
+            : eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL)) {
+            display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+            if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL)) {
+                error = "eglInitialize failed";
+                return false;
+            }
+        }
+        eglBindAPI(EGL_OPENGL_API);
+
+        // Surfaceless displays may offer no configs at all; EGL_KHR_no_config_context
+        // then lets the context be created without one
+        const EGLint configAttributes[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+        EGLConfig config = EGL_NO_CONFIG_KHR;
+        EGLint configCount = 0;
+        if (!eglChooseConfig(display, configAttributes, &config, 1, &configCount) || configCount == 0) {
+            config = EGL_NO_CONFIG_KHR;
+        }
+        const EGLint contextAttributes[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 3,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE
+        };
+        context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+        if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+            error = "no surfaceless GL 3.3 core context (EGL error 0x" + toHex(eglGetError()) + ")";
+            return false;
+        }
+        return true;
+#elif defined(HEADLESS_OSMESA)
+        const int attributes[] = {
+            OSMESA_FORMAT, OSMESA_RGBA, OSMESA_DEPTH_BITS, 24, OSMESA_PROFILE, OSMESA_CORE_PROFILE,
+            OSMESA_CONTEXT_MAJOR_VERSION, 3, OSMESA_CONTEXT_MINOR_VERSION, 3, 0
+        };
+        context = OSMesaCreateContextAttribs(attributes, NULL);
+        // OSMesa wants a color buffer to make the context current; the FBO is drawn instead
+        buffer.resize(4);
+        if (!context || !OSMesaMakeCurrent(context, buffer.data(), GL_UNSIGNED_BYTE, 1, 1)) {
+            error = "OSMesa GL 3.3 core context creation failed";
+            return false;
+        }
+        return true;
+#else
+        error = "built without a headless backend; rebuild with -DHEADLESS_EGL or -DHEADLESS_OSMESA";
+        return false;
+#endif
+    }
+
+    const char* backend() const {
+#if defined(HEADLESS_EGL)
+        return "egl";
+#elif defined(HEADLESS_OSMESA)
+        return "osmesa";
+#else
+        return "none";
+#endif
+    }
+
+    void destroy() {
+#if defined(HEADLESS_EGL)
+        if (display != EGL_NO_DISPLAY) {
+            eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            if (context != EGL_NO_CONTEXT) eglDestroyContext(display, context);
+            eglTerminate(display);
+        }
+#elif defined(HEADLESS_OSMESA)
+        if (context) OSMesaDestroyContext(context);
+#endif
+    }
+
+private:
+#if defined(HEADLESS_EGL)
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+
+    static std::string toHex(EGLint value) {
+        std::ostringstream out;
+        out << std::hex << value;
+        return out.str();
+    }
+#elif defined(HEADLESS_OSMESA)
+    OSMesaContext context = NULL;
+    std::vector<unsigned char> buffer;
+#endif
+};
+
+// Color + depth framebuffer the headless runs draw into
+class OffscreenTarget {
+public:
+    int width = 0, height = 0;
+
+    bool create(int targetWidth, int targetHeight) {
+        width = targetWidth;
+        height = targetHeight;
+        glGenFramebuffers(1, &framebuffer);
+        glGenRenderbuffers(2, renderbuffers);
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+        glViewport(0, 0, width, height);
+        return glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    }
+
+    // Tightly packed RGB rows, top row first
+    std::vector<unsigned char> readPixels() const {
+        std::vector<unsigned char> rgba(static_cast<size_t>(width) * height * 4), rgb(static_cast<size_t>(width) * height * 3);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+        for (int y = 0; y < height; ++y) {
+            const unsigned char* source = &rgba[static_cast<size_t>(height - 1 - y) * width * 4];
+            unsigned char* target = &rgb[static_cast<size_t>(y) * width * 3];
+            for (int x = 0; x < width; ++x) {
+                std::memcpy(target + x * 3, source + x * 4, 3);
+            }
+        }
+        return rgb;
+    }
+
+    void destroy() {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteRenderbuffers(2, renderbuffers);
+    }
+
+private:
+    GLuint framebuffer = 0;
+    GLuint renderbuffers[2] = { 0, 0 };
+};
+
+bool readPpm(const std::string& path, int& width, int& height, std::vector<unsigned char>& rgb) {
+    std::ifstream file(path, std::ios::binary);
+    std::string magic;
+    int maxValue = 0;
+    if (!(file >> magic >> width >> height >> maxValue) || magic != "P6" || maxValue != 255 || width <= 0 || height <= 0) {
+        return false;
+    }
+    file.get();
+    rgb.resize(static_cast<size_t>(width) * height * 3);
+    file.read(reinterpret_cast<char*>(rgb.data()), rgb.size());
+    return static_cast<bool>(file);
+}
+
+// Per-frame samples in milliseconds, summarized as mean and percentiles
+struct FrameTimes {
+    std::vector<double> samples;
+
+    double percentile(double p) const {
+        if (samples.empty()) return 0.0;
+        std::vector<double> sorted = samples;
+        std::sort(sorted.begin(), sorted.end());
+        size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+        return sorted[std::min(sorted.size() - 1, rank > 0 ? rank - 1 : 0)];
+    }
+
+    double mean() const {
+        double sum = 0.0;
+        for (double sample : samples) sum += sample;
+        return samples.empty() ? 0.0 : sum / samples.size();
+    }
+
+    double stddev() const {
+        if (samples.size() < 2) return 0.0;
+        double average = mean(), sum = 0.0;
+        for (double sample : samples) sum += (sample - average) * (sample - average);
+        return std::sqrt(sum / (samples.size() - 1));
+    }
+
+    void writeJson(std::ostream& out) const {
+        out << "{\"mean\": " << mean() << ", \"stddev\": " << stddev() << ", \"p50\": " << percentile(50)
+            << ", \"p95\": " << percentile(95) << ", \"p99\": " << percentile(99) << "}";
+    }
+
+    // One line for the console: mean, spread and tail
+    void print(std::ostream& out, const char* label) const {
+        out << label << ": " << samples.size() << " samples, mean " << mean() << " ms, stddev " << stddev()
+            << " ms, p99 " << percentile(99) << " ms" << std::endl;
+    }
+};
+
+// writePpm, writePng and FrameCapture are kept identical to their copies in asda,
+// indentation aside; a fix to one belongs in both
+bool writePpm(const std::string& path, int width, int height, const std::vector<unsigned char>& rgb) {
+    std::ofstream file(path, std::ios::binary);
+    file << "P6\n" << width << " " << height << "\n255\n";
+    file.write(reinterpret_cast<const char*>(rgb.data()), rgb.size());
+    return static_cast<bool>(file);
+}
+
+// PNG with stored (uncompressed) deflate blocks: larger than a real encoder's output
+// but needs no zlib, and every viewer opens it
+bool writePng(const std::string& path, int width, int height, const std::vector<unsigned char>& rgb) {
+    // Built once; static initialization is thread-safe, so capture writers may race here
+    static const std::array<uint32_t, 256> crcTable = []() {
+        std::array<uint32_t, 256> table;
+        for (uint32_t n = 0; n < 256; ++n) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+        return table;
+    }();
+    std::ofstream file(path, std::ios::binary);
+    auto put32 = [](std::vector<unsigned char>& out, uint32_t value) {
+        for (int shift = 24; shift >= 0; shift -= 8) out.push_back(static_cast<unsigned char>(value >> shift));
+    };
+    auto chunk = [&](const char* type, const std::vector<unsigned char>& data) {
+        std::vector<unsigned char> bytes;
+        put32(bytes, static_cast<uint32_t>(data.size()));
+        bytes.insert(bytes.end(), type, type + 4);
+        bytes.insert(bytes.end(), data.begin(), data.end());
+        uint32_t crc = 0xffffffffu;
+        for (size_t i = 4; i < bytes.size(); ++i) crc = crcTable[(crc ^ bytes[i]) & 0xff] ^ (crc >> 8);
+        put32(bytes, crc ^ 0xffffffffu);
+        file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    };
+
+    file.write("\x89PNG\r\n\x1a\n", 8);
+    std::vector<unsigned char> header;
+    put32(header, width);
+    put32(header, height);
+    header.insert(header.end(), { 8, 2, 0, 0, 0 }); // 8-bit RGB, no interlace
+    chunk("IHDR", header);
+
+    // Scanlines with filter type 0, wrapped in a zlib stream of stored blocks
+    std::vector<unsigned char> raw;
+    raw.reserve(static_cast<size_t>(width * 3 + 1) * height);
+    for (int y = 0; y < height; ++y) {
+        raw.push_back(0);
+        const unsigned char* row = rgb.data() + static_cast<size_t>(y) * width * 3;
+        raw.insert(raw.end(), row, row + static_cast<size_t>(width) * 3);
+    }
+    std::vector<unsigned char> zlib = { 0x78, 0x01 };
+    for (size_t offset = 0; offset < raw.size() || offset == 0; offset += 65535) {
+        size_t length = std::min<size_t>(65535, raw.size() - offset);
+        zlib.push_back(offset + length >= raw.size() ? 1 : 0);
+        zlib.push_back(static_cast<unsigned char>(length));
+        zlib.push_back(static_cast<unsigned char>(length >> 8));
+        zlib.push_back(static_cast<unsigned char>(~length));
+        zlib.push_back(static_cast<unsigned char>(~length >> 8));
+        zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + length);
+        if (raw.empty()) break;
+    }
+    uint32_t a = 1, b = 0;
+    for (unsigned char byte : raw) {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+    put32(zlib, (b << 16) | a);
+    chunk("IDAT", zlib);
+    chunk("IEND", std::vector<unsigned char>());
+    return static_cast<bool>(file);
+}
+
+// Records frames without a synchronous glReadPixels. Each captured frame is read into
+// the next of a ring of pixel-pack buffers and fenced; later frames map the buffers
+// whose fences have signaled and queue the pixels for a writer thread, which flips,
+// converts and writes them. Only a full ring waits on the GPU. A writer more than
+// queueLimit frames behind makes new frames drop rather than stall rendering; dropped
+// frames are counted, and so are reads lost to a failed fence wait or map. Frames go to
+// DIRECTORY/frame_NNNNNN.ppm|png|rgb, or as raw top-down RGB to the stdin of an
+// encoder command, e.g.
+//   ffmpeg -f rawvideo -pix_fmt rgb24 -s 1920x1080 -r 60 -i - capture.mp4
+class FrameCapture {
+public:
+    enum Format { PPM, PNG, RAW };
+
+    // Format from its name: ppm, png or raw
+    static bool parseFormat(const std::string& name, Format& format) {
+        if (name == "ppm") format = PPM;
+        else if (name == "png") format = PNG;
+        else if (name == "raw") format = RAW;
+        else return false;
+        return true;
+    }
+
+    // Frames go to pipeCommand when it is not empty, else to files in directory
+    bool start(const std::string& directory, Format format, const std::string& pipeCommand, size_t queueLimit,
+        std::string& error) {
+        this->directory = directory;
+        this->format = format;
+        this->queueLimit = std::max<size_t>(1, queueLimit);
+        if (!pipeCommand.empty()) {
+#if defined(_WIN32)
+            pipe = _popen(pipeCommand.c_str(), "wb");
+#else
+            std::signal(SIGPIPE, SIG_IGN); // an encoder that exits early fails a write instead
+            pipe = popen(pipeCommand.c_str(), "w");
+#endif
+            if (!pipe) {
+                error = "could not run " + pipeCommand;
+                return false;
+            }
+        }
+        else {
+            std::string probe = directory + "/.capture";
+            if (!std::ofstream(probe, std::ios::binary)) {
+                error = "cannot write to " + directory;
+                return false;
+            }
+            std::remove(probe.c_str());
+        }
+        for (Slot& slot : ring) glGenBuffers(1, &slot.buffer);
+        stopping = false;
+        writeFailed = false;
+        writer = std::thread(&FrameCapture::writeFrames, this);
+        active = true;
+        return true;
+    }
+
+    bool isActive() const { return active; }
+
+    // Queues the lower-left width x height pixels of the bound read framebuffer
+    void capture(int width, int height) {
+        if (!active || width <= 0 || height <= 0) return;
+        typedef std::chrono::steady_clock Clock;
+        Clock::time_point start = Clock::now();
+        collect(false);
+        if (pending == ring.size()) {
+            collect(true);
+            stallMilliseconds += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        }
 
-    void setupBuffers(int index, const Shape& shape) {
-        glBindVertexArray(VAO[index]);
+        Slot& slot = ring[(head + pending) % ring.size()];
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        if (slot.width != width || slot.height != height) {
+            glBufferData(GL_PIXEL_PACK_BUFFER, static_cast<size_t>(width) * height * 4, nullptr, GL_STREAM_READ);
+            slot.width = width;
+            slot.height = height;
+        }
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        slot.index = captured++;
+        ++pending;
+        lastOverheadMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        overheadMilliseconds += lastOverheadMilliseconds;
+    }
 
-        glBindBuffer(GL_ARRAY_BUFFER, VBO[index]);
-        glBufferData(GL_ARRAY_BUFFER, shape.vertices.size() * sizeof(float),
-            shape.vertices.data(), GL_STATIC_DRAW);
+    // Frames read back but not yet written
+    size_t queued() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return queue.size() + pending;
+    }
 
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO[index]);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, shape.indices.size() * sizeof(unsigned int),
-            shape.indices.data(), GL_STATIC_DRAW);
+    size_t frames() const { return captured; }
 
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
-        glEnableVertexAttribArray(0);
+    // Render-thread milliseconds spent in the latest capture()
+    double lastOverheadMs() const { return lastOverheadMilliseconds; }
 
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
-        glEnableVertexAttribArray(1);
+    // Waits for outstanding reads and the writer, then releases the buffers and the pipe
+    void finish() {
+        if (!active) return;
+        while (pending > 0) collect(true);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        ready.notify_all();
+        writer.join();
+        for (Slot& slot : ring) {
+            glDeleteBuffers(1, &slot.buffer);
+            slot = Slot();
+        }
+        if (pipe) {
+#if defined(_WIN32)
+            _pclose(pipe);
+#else
+            pclose(pipe);
+#endif
+            pipe = nullptr;
+        }
+        active = false;
     }
 
-    void render() {
-        glUseProgram(shaderProgram);
-
-        // Update rotation angle
-        rotationAngle += 0.1f;
-        if (rotationAngle >= 360.0f) rotationAngle = 0.0f;
+    void print(std::ostream& out) {
+        std::lock_guard<std::mutex> lock(mutex);
+        out << "Captured " << captured << " frames: " << written << " written, " << dropped << " dropped, " << failed
+            << " failed, at most " << maxQueued << " queued" << (writeFailed ? ", writing FAILED" : "") << "; "
+            << meanOverheadMs() << " ms/frame on the render thread, " << stallMilliseconds << " ms stalled on a full ring"
+            << std::endl;
+    }
 
-        // Setup camera view
-        glm::mat4 view = glm::lookAt(
-            glm::vec3(0.0f, 0.0f, 5.0f),
-            glm::vec3(0.0f),
-            glm::vec3(0.0f, 1.0f, 0.0f)
-        );
+    void writeJson(std::ostream& out) {
+        std::lock_guard<std::mutex> lock(mutex);
+        out << "{\"frames\": " << captured << ", \"written\": " << written << ", \"dropped\": " << dropped
+            << ", \"failed\": " << failed << ", \"max_queued\": " << maxQueued << ", \"write_failed\": "
+            << (writeFailed ? "true" : "false") << ", \"stall_ms\": " << stallMilliseconds << ", \"overhead_ms\": "
+            << meanOverheadMs() << "}";
+    }
 
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+private:
+    struct Slot {
+        GLuint buffer = 0;
+        GLsync fence = nullptr;
+        int width = 0, height = 0;
+        size_t index = 0;
+    };
 
-        // Render cube (left side)
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-1.5f, 0.0f, 0.0f));
-        model = glm::rotate(model, glm::radians(rotationAngle), glm::vec3(0.5f, 1.0f, 0.0f));
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-        glBindVertexArray(VAO[0]);
-        glDrawElements(GL_TRIANGLES, shapes[0].indices.size(), GL_UNSIGNED_INT, 0);
-
-        // Render pyramid (right side)
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(1.5f, 0.0f, 0.0f));
-        model = glm::rotate(model, glm::radians(rotationAngle), glm::vec3(0.5f, 1.0f, 0.0f));
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-        glBindVertexArray(VAO[1]);
-        glDrawElements(GL_TRIANGLES, shapes[1].indices.size(), GL_UNSIGNED_INT, 0);
-
-        // Render selection UI
-        ImGui::SetNextWindowPos(ImVec2(ImGui::GetIO().DisplaySize.x * 0.5f, ImGui::GetIO().DisplaySize.y * 0.8f),
-            ImGuiCond_Always, ImVec2(0.5f, 0.5f));
-        ImGui::Begin("Shape Selection", nullptr,
-            ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoTitleBar);
+    struct Frame {
+        size_t index;
+        int width, height;
+        std::vector<unsigned char> rgba; // bottom row first, as read
+    };
 
-        ImGui::Text("Choose a shape to begin:");
-        ImGui::Spacing();
+    double meanOverheadMs() const { return captured ? overheadMilliseconds / captured : 0.0; }
 
-        if (ImGui::Button("Select Cube", ImVec2(120, 40))) selectedShape = 0;
-        ImGui::SameLine(0, 20);
-        if (ImGui::Button("Select Pyramid", ImVec2(120, 40))) selectedShape = 1;
+    // Hands finished reads to the writer in capture order. Waits for the oldest one when
+    // wait is set, and otherwise stops at the first read still in flight.
+    void collect(bool wait) {
+        while (pending > 0) {
+            Slot& slot = ring[head];
+            GLenum status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? 1000000000ull : 0);
+            if (status == GL_TIMEOUT_EXPIRED && wait) continue;
+            if (status == GL_TIMEOUT_EXPIRED) return;
+            wait = false;
+            glDeleteSync(slot.fence);
+            slot.fence = nullptr;
+            head = (head + 1) % ring.size();
+            --pending;
+            if (status == GL_WAIT_FAILED) {
+                // Nothing says the read finished, so its buffer is never mapped
+                std::lock_guard<std::mutex> lock(mutex);
+                ++failed;
+                continue;
+            }
 
-        ImGui::End();
+            Frame frame = { slot.index, slot.width, slot.height, std::vector<unsigned char>() };
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (queue.size() >= queueLimit) {
+                    ++dropped;
+                    continue;
+                }
+                if (!spare.empty()) {
+                    frame.rgba.swap(spare.back());
+                    spare.pop_back();
+                }
+            }
+            size_t bytes = static_cast<size_t>(slot.width) * slot.height * 4;
+            frame.rgba.resize(bytes);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+            const void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+            if (mapped) {
+                std::memcpy(frame.rgba.data(), mapped, bytes);
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            }
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!mapped) {
+                    ++failed;
+                    continue;
+                }
+                queue.push_back(std::move(frame));
+                maxQueued = std::max(maxQueued, queue.size());
+            }
+            ready.notify_one();
+        }
     }
 
-    int getSelectedShape() const { return selectedShape; }
+    void writeFrames() {
+        std::vector<unsigned char> rgb;
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            ready.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (queue.empty()) return;
+            Frame frame = std::move(queue.front());
+            queue.pop_front();
+            lock.unlock();
 
-    void cleanup() {
-        glDeleteVertexArrays(2, VAO);
-        glDeleteBuffers(2, VBO);
-        glDeleteBuffers(2, EBO);
-        glDeleteProgram(shaderProgram);
-    }
-};
+            rgb.resize(static_cast<size_t>(frame.width) * frame.height * 3);
+            for (int y = 0; y < frame.height; ++y) {
+                const unsigned char* source = &frame.rgba[static_cast<size_t>(frame.height - 1 - y) * frame.width * 4];
+                unsigned char* target = &rgb[static_cast<size_t>(y) * frame.width * 3];
+                for (int x = 0; x < frame.width; ++x) std::memcpy(target + x * 3, source + x * 4, 3);
+            }
+            bool ok;
+            if (pipe) {
+                ok = std::fwrite(rgb.data(), 1, rgb.size(), pipe) == rgb.size();
+            }
+            else {
+                char name[32];
+                std::snprintf(name, sizeof(name), "/frame_%06zu.", frame.index);
+                std::string path = directory + name + (format == PNG ? "png" : format == PPM ? "ppm" : "rgb");
+                if (format == PNG) ok = writePng(path, frame.width, frame.height, rgb);
+                else if (format == PPM) ok = writePpm(path, frame.width, frame.height, rgb);
+                else {
+                    std::ofstream file(path, std::ios::binary);
+                    file.write(reinterpret_cast<const char*>(rgb.data()), rgb.size());
+                    ok = static_cast<bool>(file);
+                }
+            }
 
-// Renderer class for transformation mode
-class Renderer {
-private:
-    GLuint VAO, VBO, EBO;
-    GLuint shaderProgram;
-    Shape currentShape;
-    GLFWwindow* window;
+            lock.lock();
+            if (ok) ++written;
+            else writeFailed = true;
+            spare.push_back(std::move(frame.rgba));
+        }
+    }
 
-    // Default values for reset
-    const glm::vec3 DEFAULT_TRANSLATION{ 0.0f };
-    const glm::vec3 DEFAULT_ROTATION{ 0.0f };
-    const glm::vec3 DEFAULT_SCALE{ 1.0f };
-    const glm::vec3 DEFAULT_SHEAR{ 0.0f };
-    const glm::vec3 DEFAULT_CAMERA_POS{ 0.0f, 0.0f, 3.0f };
+    std::string directory;
+    Format format = PPM;
+    size_t queueLimit = 8;
+    std::FILE* pipe = nullptr;
+    bool active = false;
 
-    // Transformation parameters
-    glm::vec3 translation{ 0.0f };
-    glm::vec3 rotation{ 0.0f };
-    glm::vec3 scale{ 1.0f };
-    glm::vec3 shear{ 0.0f };
-    bool reflection[3] = { false, false, false };
+    // Render thread only
+    std::array<Slot, 3> ring;
+    size_t head = 0, pending = 0, captured = 0;
+    double overheadMilliseconds = 0.0, lastOverheadMilliseconds = 0.0, stallMilliseconds = 0.0;
 
-    // Camera parameters
-    glm::vec3 cameraPos{ 0.0f, 0.0f, 3.0f };
-    glm::mat4 projection;
+    // Shared with the writer under mutex
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<Frame> queue;
+    std::vector<std::vector<unsigned char>> spare; // recycled frame storage
+    size_t written = 0, dropped = 0, failed = 0, maxQueued = 0;
+    bool stopping = false, writeFailed = false;
+    std::thread writer;
+};
 
-    bool isFullscreen = false;
-    GLFWmonitor* primaryMonitor;
-    int windowed_x, windowed_y, windowed_width, windowed_height;
+// Result of one scripted scenario in the headless harness
+struct ScenarioResult {
+    std::string name;
+    size_t objects = 0;
+    FrameTimes cpu;   // issuing the frame's GL calls, or the whole software frame
+    FrameTimes gpu;   // GL_TIME_ELAPSED around the same calls
+    FrameTimes frame; // start to start, including waiting on the GPU
+    FrameTimes latency; // input stamped at a frame's start until the frame showing it is issued
+    FrameTimes capture; // --capture work on the rendering thread
+    std::string golden = "skipped";
+    int maxDifference = 0;
+    size_t differingPixels = 0;
+};
 
-public:
-    Renderer(GLFWwindow* win) : window(win) {
-        primaryMonitor = glfwGetPrimaryMonitor();
-        setupShaders();
-        setupBuffers();
-        updateProjection();
+// Renders fixed scripts into an offscreen target and reports frame-time percentiles as
+// JSON, optionally writing the last frame of each script and comparing it with a golden
+// image. Scripts advance by a fixed 1/60 s per frame, so the same options always
+// produce the same image. The software backend draws the same scripts with
+// SoftwareRasterizer and needs no GL driver; scene-per-object is GL-only, since the
+// rasterizer takes every object the same way. With --update-thread the selector and
+// scene scripts animate on an UpdateThread in real time instead, which makes their
+// images timing dependent, so they are not compared with golden images. --model draws
+// a loaded mesh in the transform script instead of the cube, run through optimizeMesh()
+// first unless --no-optimize is given (--optimize-overdraw adds its overdraw pass).
+// --capture records every measured frame through a FrameCapture, or with --capture-sync
+// through glReadPixels and a write on the rendering thread, for comparison.
+//   3d --headless [--frames N] [--warmup N] [--size WxH] [--instances N]
+//                 [--scenario selector|transform|scene|scene-per-object|all]
+//                 [--backend gl|software] [--threads N] [--update-thread] [--update-hz N]
+//                 [--model FILE] [--no-optimize] [--optimize-overdraw]
+//                 [--capture DIR] [--capture-format ppm|png|raw] [--capture-pipe CMD]
+//                 [--capture-queue N] [--capture-sync]
+//                 [--write-frames DIR] [--image-format ppm|png] [--golden DIR]
+//                 [--golden-tolerance N] [--json FILE]
+// Exit status: 0 on success, 1 when a golden image differs, 2 when no context or
+// framebuffer could be created.
+int runHeadless(int argc, char** argv) {
+    typedef std::chrono::steady_clock Clock;
+    int frames = 300, warmup = 10, width = 800, height = 600, tolerance = 2;
+    size_t instances = 100000;
+    unsigned threads = 0;
+    bool useUpdateThread = false, optimizeModel = true, overdrawPass = false;
+    double updateRate = 120.0;
+    std::string modelPath;
+    std::string captureDirectory, capturePipe, captureFormatName = "ppm";
+    size_t captureQueue = 8;
+    bool captureSync = false;
+    std::string scenario = "all", frameDirectory, goldenDirectory, jsonPath, imageFormat = "ppm", backend = "gl";
+    for (int i = 2; i < argc; ++i) {
+        std::string option = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (option == "--frames" && hasValue) frames = std::max(1, std::atoi(argv[++i]));
+        else if (option == "--warmup" && hasValue) warmup = std::max(0, std::atoi(argv[++i]));
+        else if (option == "--size" && hasValue) std::sscanf(argv[++i], "%dx%d", &width, &height);
+        else if (option == "--instances" && hasValue) instances = std::strtoul(argv[++i], nullptr, 10);
+        else if (option == "--scenario" && hasValue) scenario = argv[++i];
+        else if (option == "--backend" && hasValue) backend = argv[++i];
+        else if (option == "--threads" && hasValue) threads = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        else if (option == "--update-thread") useUpdateThread = true;
+        else if (option == "--update-hz" && hasValue) updateRate = std::atof(argv[++i]);
+        else if (option == "--model" && hasValue) modelPath = argv[++i];
+        else if (option == "--no-optimize") optimizeModel = false;
+        else if (option == "--optimize-overdraw") overdrawPass = true;
+        else if (option == "--capture" && hasValue) captureDirectory = argv[++i];
+        else if (option == "--capture-format" && hasValue) captureFormatName = argv[++i];
+        else if (option == "--capture-pipe" && hasValue) capturePipe = argv[++i];
+        else if (option == "--capture-queue" && hasValue) captureQueue = std::strtoul(argv[++i], nullptr, 10);
+        else if (option == "--capture-sync") captureSync = true;
+        else if (option == "--write-frames" && hasValue) frameDirectory = argv[++i];
+        else if (option == "--image-format" && hasValue) imageFormat = argv[++i];
+        else if (option == "--golden" && hasValue) goldenDirectory = argv[++i];
+        else if (option == "--golden-tolerance" && hasValue) tolerance = std::atoi(argv[++i]);
+        else if (option == "--json" && hasValue) jsonPath = argv[++i];
+        else {
+            std::cerr << "Unknown headless option " << option << std::endl;
+            return 2;
+        }
     }
+    if (backend != "gl" && backend != "software") {
+        std::cerr << "Unknown headless backend " << backend << std::endl;
+        return 2;
+    }
+    bool software = backend == "software";
+    if (software && useUpdateThread) {
+        std::cerr << "--update-thread needs the gl backend" << std::endl;
+        return 2;
+    }
+    bool capturing = !captureDirectory.empty() || !capturePipe.empty();
+    FrameCapture::Format captureFormat = FrameCapture::PPM;
+    if (capturing && (software || !FrameCapture::parseFormat(captureFormatName, captureFormat))) {
+        std::cerr << (software ? "--capture needs the gl backend" : "Unknown capture format " + captureFormatName) << std::endl;
+        return 2;
+    }
+    if (captureSync && (captureDirectory.empty() || captureFormat == FrameCapture::RAW)) {
+        std::cerr << "--capture-sync writes ppm or png files to a --capture directory" << std::endl;
+        return 2;
+    }
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
 
-    void setShape(Shape::Type shapeType) {
-        if (shapeType == Shape::CUBE) {
-            currentShape.createCube();
+    Shape model;
+    if (!modelPath.empty()) {
+        MeshLoadStats stats;
+        std::string error;
+        if (!loadMesh(modelPath, model, stats, error, threads)) {
+            std::cerr << "Could not load " << modelPath << ": " << error << std::endl;
+            return 2;
         }
-        else {
-            currentShape.createPyramid();
+        printMeshLoadStats(std::cerr, modelPath, stats);
+        if (optimizeModel) {
+            MeshOptimizeStats optimizeStats;
+            optimizeMesh(model, optimizeStats, nullptr, overdrawPass);
+            printMeshOptimizeStats(std::cerr, optimizeStats);
         }
-        updateBuffers();
+        model.fitUnitCube();
+        if (!stats.colored) model.colorByPosition();
     }
-
-    void updateProjection() {
-        int width, height;
-        glfwGetFramebufferSize(window, &width, &height);
-        projection = glm::perspective(glm::radians(45.0f), (float)width / (float)height, 0.1f, 100.0f);
+    else {
+        model.createCube();
     }
 
-    void resetTransformations() {
-        translation = DEFAULT_TRANSLATION;
-        rotation = DEFAULT_ROTATION;
-        scale = DEFAULT_SCALE;
-        shear = DEFAULT_SHEAR;
-        cameraPos = DEFAULT_CAMERA_POS;
-        reflection[0] = reflection[1] = reflection[2] = false;
+    HeadlessContext context;
+    OffscreenTarget target;
+    std::unique_ptr<ProgramCache> programCache;
+    std::unique_ptr<GeometryPool> geometry;
+    std::unique_ptr<SoftwareRasterizer> rasterizer;
+    PoolMesh modelMesh;
+    FrameCapture capture;
+    size_t syncCaptured = 0;
+    std::string backendName, rendererName, versionName;
+    Shape shapes[2];
+    if (software) {
+        rasterizer.reset(new SoftwareRasterizer(width, height, threads));
+        shapes[0].createCube();
+        shapes[1].createPyramid();
+        backendName = "software";
+        rendererName = "tile rasterizer (" + std::to_string(rasterizer->threads()) + " threads, " +
+            std::to_string(VectorLanes::width) + " lanes)";
+        versionName = "none";
     }
+    else {
+        std::string error;
+        if (!context.create(error)) {
+            std::cerr << "Headless context: " << error << std::endl;
+            return 2;
+        }
+        glewExperimental = GL_TRUE;
+        GLenum glewStatus = glewInit();
+        // GLEW built for GLX reports a missing X display under EGL after loading the GL
+        // entry points, which is all that is needed here
+        if (glewStatus != GLEW_OK && glewStatus != GLEW_ERROR_NO_GLX_DISPLAY) {
+            std::cerr << "Failed to initialize GLEW" << std::endl;
+            context.destroy();
+            return 2;
+        }
 
-    void toggleFullscreen() {
-        if (!isFullscreen) {
-            glfwGetWindowPos(window, &windowed_x, &windowed_y);
-            glfwGetWindowSize(window, &windowed_width, &windowed_height);
-            const GLFWvidmode* mode = glfwGetVideoMode(primaryMonitor);
-            glfwSetWindowMonitor(window, primaryMonitor, 0, 0, mode->width, mode->height, mode->refreshRate);
+        if (!target.create(width, height)) {
+            std::cerr << "Offscreen framebuffer incomplete" << std::endl;
+            target.destroy();
+            context.destroy();
+            return 2;
         }
-        else {
-            glfwSetWindowMonitor(window, nullptr, windowed_x, windowed_y, windowed_width, windowed_height, 0);
+        glEnable(GL_DEPTH_TEST);
+        programCache.reset(new ProgramCache(std::cerr));
+        geometry.reset(new GeometryPool());
+        modelMesh = geometry->add("model", model);
+        backendName = context.backend();
+        std::string captureError;
+        if (capturing && !captureSync && !capture.start(captureDirectory, captureFormat, capturePipe, captureQueue, captureError)) {
+            std::cerr << "Capture: " << captureError << std::endl;
+            geometry->cleanup();
+            programCache->cleanup();
+            target.destroy();
+            context.destroy();
+            return 2;
         }
-        isFullscreen = !isFullscreen;
-        updateProjection();
+        rendererName = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+        versionName = reinterpret_cast<const char*>(glGetString(GL_VERSION));
     }
 
-    void setupShaders() {
-        GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
-        glCompileShader(vertexShader);
+    std::vector<ScenarioResult> results;
+    bool goldenMismatch = false;
+    const float frameStep = 1.0f / 60.0f;
+    const float aspect = static_cast<float>(width) / height;
 
-        GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
-        glCompileShader(fragmentShader);
+    // Script parameters shared by both backends
+    struct TransformFrame {
+        glm::vec3 translation, rotation, scale, shear;
+        bool reflection[3];
+    };
+    auto transformFrame = [&](int n) {
+        float t = n * frameStep;
+        TransformFrame frame = { glm::vec3(std::sin(t) * 0.5f, std::cos(t * 0.7f) * 0.3f, 0.0f),
+            glm::vec3(n * 2.0f, n * 3.0f, n * 1.0f), glm::vec3(1.0f + 0.3f * std::sin(t * 1.3f)),
+            glm::vec3(0.2f * std::sin(t * 0.5f), 0.0f, 0.1f * std::cos(t * 0.9f)),
+            { (n / 60) % 2 == 1, false, (n / 120) % 2 == 1 } };
+        return frame;
+    };
+    auto sceneCamera = [&](int n, float distance, glm::mat4& view, glm::mat4& projection) {
+        InstancedScene::orbitCamera(n * frameStep * 0.2f, distance, aspect, view, projection);
+    };
 
-        shaderProgram = glCreateProgram();
-        glAttachShader(shaderProgram, vertexShader);
-        glAttachShader(shaderProgram, fragmentShader);
-        glLinkProgram(shaderProgram);
+    const char* scenarios[] = { "selector", "transform", "scene", "scene-per-object" };
+    for (const char* name : scenarios) {
+        if (scenario != "all" && scenario != name) continue;
+        std::string script = name;
+        if (software && script == "scene-per-object") continue;
 
-        glDeleteShader(vertexShader);
-        glDeleteShader(fragmentShader);
-    }
+        // Each script is a setup plus a draw callback for frame n
+        std::unique_ptr<ShapeSelector> selector;
+        std::unique_ptr<Renderer> renderer;
+        std::unique_ptr<InstancedScene> scene;
+        std::function<void(int)> drawFrame;
+        ScenarioResult result;
+        result.name = script;
 
-    void setupBuffers() {
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
-    }
+        // Software script state, mirroring what the GL classes keep
+        float selectorAngle = 0.0f, sceneExtent = 0.0f;
+        InstancedScene::InstanceArrays sceneArrays[2];
+        std::vector<glm::mat4> sceneMatrices[2];
+        std::unique_ptr<WorkStealingPool> matrixPool;
 
-    void updateBuffers() {
-        glBindVertexArray(VAO);
+        // Threaded scripts draw the newest snapshot, taken at the start of each frame
+        std::unique_ptr<UpdateThread> updates;
+        UpdateThread::Request request;
+        const FrameSnapshot* snapshot = nullptr;
+        if (useUpdateThread && script != "transform") {
+            updates.reset(new UpdateThread(updateRate));
+            request.mode = script == "selector" ? UpdateThread::INTRO : UpdateThread::SCENE;
+            request.sceneInstances = instances;
+            request.width = width;
+            request.height = height;
+        }
 
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, currentShape.vertices.size() * sizeof(float),
-            currentShape.vertices.data(), GL_STATIC_DRAW);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, currentShape.indices.size() * sizeof(unsigned int),
-            currentShape.indices.data(), GL_STATIC_DRAW);
+        if (script == "selector") {
+            result.objects = 2;
+            if (software) {
+                glm::mat4 viewProjection = glm::perspective(glm::radians(45.0f), aspect, 0.1f, 100.0f) * ShapeSelector::viewMatrix();
+                drawFrame = [&, viewProjection](int) {
+                    selectorAngle = ShapeSelector::advanceRotation(selectorAngle, frameStep);
+                    for (int shape = 0; shape < 2; ++shape) {
+                        rasterizer->draw(shapes[shape], viewProjection * ShapeSelector::modelMatrix(shape, selectorAngle));
+                    }
+                };
+            }
+            else {
+                selector.reset(new ShapeSelector(*programCache, *geometry));
+                selector->updateProjection(width, height);
+                drawFrame = [&](int) {
+                    if (updates) selector->setRotation(snapshot->selectorAngle);
+                    else selector->update(frameStep);
+                    selector->render();
+                };
+            }
+        }
+        else if (script == "transform") {
+            result.objects = 1;
+            if (software) {
+                glm::mat4 viewProjection = glm::perspective(glm::radians(45.0f), aspect, 0.1f, 100.0f) *
+                    glm::lookAt(glm::vec3(0.0f, 0.0f, 3.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+                drawFrame = [&, viewProjection](int n) {
+                    TransformFrame frame = transformFrame(n);
+                    rasterizer->draw(model, viewProjection *
+                        composeModelMatrix(frame.translation, frame.rotation, frame.scale, frame.shear, frame.reflection));
+                };
+            }
+            else {
+                renderer.reset(new Renderer(nullptr, *programCache, *geometry));
+                renderer->updateProjection(width, height);
+                renderer->setMesh(modelMesh);
+                drawFrame = [&](int n) {
+                    TransformFrame frame = transformFrame(n);
+                    renderer->setTransform(frame.translation, frame.rotation, frame.scale, frame.shear, frame.reflection);
+                    renderer->render();
+                };
+            }
+        }
+        else if (software) {
+            sceneExtent = InstancedScene::populateArrays(sceneArrays, instances, 1);
+            for (int mesh = 0; mesh < 2; ++mesh) sceneMatrices[mesh].resize(sceneArrays[mesh].size());
+            matrixPool.reset(new WorkStealingPool(threads));
+            result.objects = sceneArrays[0].size() + sceneArrays[1].size();
+            drawFrame = [&](int n) {
+                glm::mat4 view, projection;
+                sceneCamera(n, InstancedScene::viewDistance(sceneExtent), view, projection);
+                glm::mat4 viewProjection = projection * view;
+                for (int mesh = 0; mesh < 2; ++mesh) {
+                    InstancedScene::spin(sceneArrays[mesh], frameStep);
+                    composeModelMatrices(sceneArrays[mesh].batch(), sceneMatrices[mesh].data(), matrixPool.get());
+                    for (const glm::mat4& model : sceneMatrices[mesh]) rasterizer->draw(shapes[mesh], viewProjection * model);
+                }
+            };
+        }
+        else if (updates) {
+            scene.reset(new InstancedScene(*programCache, *geometry));
+            bool perObject = script == "scene-per-object";
+            drawFrame = [&, perObject](int) {
+                if (perObject) scene->drawPerObject(snapshot->view, snapshot->projection, snapshot->matrices);
+                else scene->draw(snapshot->view, snapshot->projection, snapshot->matrices);
+            };
+        }
+        else {
+            scene.reset(new InstancedScene(*programCache, *geometry));
+            scene->populate(instances);
+            result.objects = scene->size();
+            bool perObject = script == "scene-per-object";
+            drawFrame = [&, perObject](int n) {
+                glm::mat4 view, projection;
+                sceneCamera(n, scene->viewDistance(), view, projection);
+                scene->update(frameStep);
+                if (perObject) scene->renderPerObject(view, projection);
+                else scene->render(view, projection);
+            };
+        }
 
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
-        glEnableVertexAttribArray(0);
+        // GPU times come back through a ring of timer queries a few frames late, so
+        // reading them does not stall the pipeline. The software backend renders
+        // synchronously and only has CPU times.
+        const int queryRing = 4;
+        GLuint queries[queryRing];
+        if (!software) glGenQueries(queryRing, queries);
+        int total = warmup + frames;
+        auto collect = [&](int n) {
+            if (software) return;
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(queries[n % queryRing], GL_QUERY_RESULT, &nanoseconds);
+            if (n >= warmup) result.gpu.samples.push_back(nanoseconds / 1e6);
+        };
 
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
-        glEnableVertexAttribArray(1);
-    }
+        // Input times are seconds on the steady clock. Without an update thread a frame
+        // shows the input stamped at its own start; with one it shows whatever input the
+        // newest snapshot was made from.
+        auto seconds = [](Clock::time_point time) { return std::chrono::duration<double>(time.time_since_epoch()).count(); };
+        double measuredInput = 0.0;
+        if (updates) {
+            updates->request(request);
+            for (snapshot = &updates->latest(); snapshot->mode != request.mode; snapshot = &updates->latest()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            if (script != "selector") result.objects = snapshot->matrices[0].size() + snapshot->matrices[1].size();
+        }
 
+        Clock::time_point previousStart = Clock::now();
+        for (int n = 0; n < total; ++n) {
+            if (n >= queryRing) collect(n - queryRing);
+            Clock::time_point start = Clock::now();
+            if (n > warmup) result.frame.samples.push_back(std::chrono::duration<double, std::milli>(start - previousStart).count());
+            previousStart = start;
 
+            double reflectedInput = seconds(start);
+            if (updates) {
+                request.inputTime = reflectedInput;
+                updates->request(request);
+                snapshot = &updates->latest();
+                reflectedInput = snapshot->inputTime;
+            }
 
-    void renderUI() {
-        // Set up ImGui window for transformations
-        ImGui::SetNextWindowPos(ImVec2(10, 10), ImGuiCond_FirstUseEver);
-        ImGui::SetNextWindowSize(ImVec2(300, 400), ImGuiCond_FirstUseEver);
-        ImGui::Begin("Transformations");
+            if (software) {
+                rasterizer->clear(glm::vec3(0.2f, 0.3f, 0.3f));
+                drawFrame(n);
+                rasterizer->flush();
+            }
+            else {
+                glBeginQuery(GL_TIME_ELAPSED, queries[n % queryRing]);
+                glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                drawFrame(n);
+                glEndQuery(GL_TIME_ELAPSED);
+                if (capturing && n >= warmup) {
+                    Clock::time_point captureStart = Clock::now();
+                    if (captureSync) {
+                        char name[32];
+                        std::snprintf(name, sizeof(name), "/frame_%06zu.%s", syncCaptured++, captureFormatName.c_str());
+                        std::vector<unsigned char> pixels = target.readPixels();
+                        if (captureFormat == FrameCapture::PNG) writePng(captureDirectory + name, width, height, pixels);
+                        else writePpm(captureDirectory + name, width, height, pixels);
+                    }
+                    else {
+                        capture.capture(width, height);
+                    }
+                    result.capture.samples.push_back(std::chrono::duration<double, std::milli>(Clock::now() - captureStart).count());
+                }
+                glFlush();
+            }
+            Clock::time_point end = Clock::now();
+            if (n >= warmup) {
+                result.cpu.samples.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+                if (reflectedInput > measuredInput) result.latency.samples.push_back((seconds(end) - reflectedInput) * 1000.0);
+            }
+            measuredInput = std::max(measuredInput, reflectedInput);
+        }
+        for (int n = std::max(0, total - queryRing); n < total; ++n) collect(n);
+        if (!software) {
+            glFinish();
+            glDeleteQueries(queryRing, queries);
+        }
+        result.frame.samples.push_back(std::chrono::duration<double, std::milli>(Clock::now() - previousStart).count());
 
-        // Translation controls
-        ImGui::Text("Translation");
-        ImGui::SliderFloat("X##Trans", &translation.x, -2.0f, 2.0f);
-        ImGui::SliderFloat("Y##Trans", &translation.y, -2.0f, 2.0f);
-        ImGui::SliderFloat("Z##Trans", &translation.z, -2.0f, 2.0f);
+        // The last frame is the one written out and compared
+        if (!frameDirectory.empty() || !goldenDirectory.empty()) {
+            std::vector<unsigned char> pixels = software ? rasterizer->readPixels() : target.readPixels();
+            if (!frameDirectory.empty()) {
+                std::string path = frameDirectory + "/" + script + "." + imageFormat;
+                bool written = imageFormat == "png" ? writePng(path, width, height, pixels) : writePpm(path, width, height, pixels);
+                if (!written) std::cerr << "Could not write " << path << std::endl;
+            }
+            if (!goldenDirectory.empty() && !updates) {
+                int goldenWidth = 0, goldenHeight = 0;
+                std::vector<unsigned char> golden;
+                if (!readPpm(goldenDirectory + "/" + script + ".ppm", goldenWidth, goldenHeight, golden)) {
+                    result.golden = "missing";
+                }
+                else if (goldenWidth != width || goldenHeight != height) {
+                    result.golden = "size-mismatch";
+                    goldenMismatch = true;
+                }
+                else {
+                    for (size_t pixel = 0; pixel < pixels.size() / 3; ++pixel) {
+                        int difference = 0;
+                        for (int channel = 0; channel < 3; ++channel) {
+                            difference = std::max(difference, std::abs(pixels[pixel * 3 + channel] - golden[pixel * 3 + channel]));
+                        }
+                        result.maxDifference = std::max(result.maxDifference, difference);
+                        if (difference > tolerance) ++result.differingPixels;
+                    }
+                    // Rasterizers may disagree on a few edge pixels; allow 0.1% of the image
+                    bool matches = result.differingPixels * 1000 <= pixels.size() / 3;
+                    result.golden = matches ? "match" : "mismatch";
+                    goldenMismatch = goldenMismatch || !matches;
+                }
+            }
+        }
 
-        ImGui::Separator();
+        if (scene) scene->cleanup();
+        results.push_back(result);
+    }
 
-        // Rotation controls
-        ImGui::Text("Rotation");
-        ImGui::SliderFloat("X##Rot", &rotation.x, 0.0f, 360.0f);
-        ImGui::SliderFloat("Y##Rot", &rotation.y, 0.0f, 360.0f);
-        ImGui::SliderFloat("Z##Rot", &rotation.z, 0.0f, 360.0f);
+    std::ostringstream json;
+    json << std::fixed << std::setprecision(4);
+    json << "{\n  \"backend\": \"" << backendName << "\",\n  \"renderer\": \"" << rendererName
+        << "\",\n  \"version\": \"" << versionName << "\",\n  \"width\": " << width << ",\n  \"height\": " << height
+        << ",\n  \"frames\": " << frames << ",\n  \"warmup\": " << warmup << ",\n  \"update_hz\": ";
+    if (useUpdateThread) json << updateRate;
+    else json << "null";
+    json << ",\n  \"scenarios\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const ScenarioResult& result = results[i];
+        json << (i ? "," : "") << "\n    {\"name\": \"" << result.name << "\", \"objects\": " << result.objects << ",\n     \"cpu_ms\": ";
+        result.cpu.writeJson(json);
+        json << ",\n     \"gpu_ms\": ";
+        if (result.gpu.samples.empty()) json << "null";
+        else result.gpu.writeJson(json);
+        json << ",\n     \"frame_ms\": ";
+        result.frame.writeJson(json);
+        json << ",\n     \"input_latency_ms\": ";
+        result.latency.writeJson(json);
+        json << ",\n     \"capture_ms\": ";
+        if (result.capture.samples.empty()) json << "null";
+        else result.capture.writeJson(json);
+        json << ",\n     \"golden\": {\"status\": \"" << result.golden << "\", \"max_difference\": " << result.maxDifference
+            << ", \"differing_pixels\": " << result.differingPixels << "}}";
+    }
+    json << "\n  ],\n  \"capture\": ";
+    capture.finish();
+    if (capturing && !captureSync) capture.writeJson(json);
+    else if (capturing) json << "{\"frames\": " << syncCaptured << ", \"written\": " << syncCaptured << ", \"synchronous\": true}";
+    else json << "null";
+    json << "\n}\n";
 
-        ImGui::Separator();
+    if (jsonPath.empty()) {
+        std::cout << json.str();
+    }
+    else {
+        std::ofstream(jsonPath) << json.str();
+    }
 
-        // Scale controls
-        ImGui::Text("Scale");
-        ImGui::SliderFloat("X##Scale", &scale.x, 0.1f, 2.0f);
-        ImGui::SliderFloat("Y##Scale", &scale.y, 0.1f, 2.0f);
-        ImGui::SliderFloat("Z##Scale", &scale.z, 0.1f, 2.0f);
+    if (!software) {
+        geometry->cleanup();
+        programCache->cleanup();
+        target.destroy();
+        context.destroy();
+    }
+    return goldenMismatch ? 1 : 0;
+}
 
-        ImGui::Separator();
+// Random transform parameters for the matrix checks, with angles well outside one turn
+struct TransformSamples {
+    std::vector<float> values[12];
+    std::vector<unsigned char> reflect;
 
-        // Shear controls
-        ImGui::Text("Shear");
-        ImGui::SliderFloat("X##Shear", &shear.x, -1.0f, 1.0f);
-        ImGui::SliderFloat("Y##Shear", &shear.y, -1.0f, 1.0f);
-        ImGui::SliderFloat("Z##Shear", &shear.z, -1.0f, 1.0f);
+    TransformSamples(size_t count, unsigned seed) : reflect(count) {
+        std::mt19937 generator(seed);
+        std::uniform_real_distribution<float> translation(-50.0f, 50.0f), angle(-1080.0f, 1080.0f);
+        std::uniform_real_distribution<float> scale(0.1f, 3.0f), shear(-1.0f, 1.0f);
+        std::uniform_real_distribution<float>* ranges[4] = { &translation, &angle, &scale, &shear };
+        for (int component = 0; component < 12; ++component) {
+            values[component].resize(count);
+            for (float& value : values[component]) value = (*ranges[component / 3])(generator);
+        }
+        for (size_t i = 0; i < count; ++i) reflect[i] = static_cast<unsigned char>(i & 7);
+    }
 
-        ImGui::Separator();
+    TransformBatch batch() const {
+        TransformBatch b = { values[0].data(), values[1].data(), values[2].data(), values[3].data(), values[4].data(),
+            values[5].data(), values[6].data(), values[7].data(), values[8].data(), values[9].data(), values[10].data(),
+            values[11].data(), reflect.data(), reflect.size() };
+        return b;
+    }
 
-        // Reflection controls
-        ImGui::Text("Reflection");
-        ImGui::Checkbox("X-axis##Refl", &reflection[0]);
-        ImGui::Checkbox("Y-axis##Refl", &reflection[1]);
-        ImGui::Checkbox("Z-axis##Refl", &reflection[2]);
+    glm::mat4 reference(size_t i) const {
+        bool reflection[3] = { (reflect[i] & 1) != 0, (reflect[i] & 2) != 0, (reflect[i] & 4) != 0 };
+        return composeModelMatrixReference(glm::vec3(values[0][i], values[1][i], values[2][i]),
+            glm::vec3(values[3][i], values[4][i], values[5][i]), glm::vec3(values[6][i], values[7][i], values[8][i]),
+            glm::vec3(values[9][i], values[10][i], values[11][i]), reflection);
+    }
+};
 
-        ImGui::Separator();
+// Compares the closed-form composer against the chained glm calls: exact angles
+// (multiples of 90 degrees), random batches that do not fill a whole vector, and
+// a threaded batch. Returns the number of mismatching matrices.
+int runMatrixTest() {
+    const float tolerance = 1e-4f;
+    size_t failures = 0, checked = 0;
+    auto compare = [&](const glm::mat4& expected, const glm::mat4& actual, const char* label, size_t index) {
+        ++checked;
+        float worst = 0.0f;
+        for (int column = 0; column < 4; ++column) {
+            for (int row = 0; row < 4; ++row) {
+                float scale = std::max(1.0f, std::fabs(expected[column][row]));
+                worst = std::max(worst, std::fabs(expected[column][row] - actual[column][row]) / scale);
+            }
+        }
+        if (worst > tolerance) {
+            if (failures < 10) std::cout << "  mismatch in " << label << " #" << index << ": " << worst << std::endl;
+            ++failures;
+        }
+    };
 
-        // Camera controls
-        ImGui::Text("Camera Position");
-        ImGui::SliderFloat("X##Cam", &cameraPos.x, -5.0f, 5.0f);
-        ImGui::SliderFloat("Y##Cam", &cameraPos.y, -5.0f, 5.0f);
-        ImGui::SliderFloat("Z##Cam", &cameraPos.z, 0.1f, 10.0f);
+    const float quarterTurns[] = { -450.0f, -180.0f, -90.0f, 0.0f, 90.0f, 180.0f, 270.0f, 360.0f, 45.0f, -135.0f };
+    for (float x : quarterTurns) {
+        for (float y : quarterTurns) {
+            for (int reflect = 0; reflect < 8; ++reflect) {
+                bool reflection[3] = { (reflect & 1) != 0, (reflect & 2) != 0, (reflect & 4) != 0 };
+                glm::vec3 translation(1.0f, -2.0f, 3.0f), rotation(x, y, x - y), scale(1.5f, 0.5f, 2.0f), shear(0.2f, -0.1f, 0.3f);
+                compare(composeModelMatrixReference(translation, rotation, scale, shear, reflection),
+                    composeModelMatrix(translation, rotation, scale, shear, reflection), "quarter turns", checked);
+            }
+        }
+    }
 
-        ImGui::Separator();
+    for (size_t count : { size_t(1), size_t(3), size_t(7), size_t(13), size_t(1000) }) {
+        TransformSamples samples(count, static_cast<unsigned>(count));
+        std::vector<glm::mat4> matrices(count);
+        composeModelMatrices(samples.batch(), matrices.data());
+        for (size_t i = 0; i < count; ++i) compare(samples.reference(i), matrices[i], "batch", i);
+    }
 
-        // Reset and fullscreen buttons
-        if (ImGui::Button("Reset Transformations")) {
-            resetTransformations();
-        }
+    TransformSamples samples(100003, 7);
+    std::vector<glm::mat4> matrices(samples.reflect.size());
+    WorkStealingPool pool(std::max(2u, std::thread::hardware_concurrency()));
+    composeModelMatrices(samples.batch(), matrices.data(), &pool);
+    for (size_t i = 0; i < matrices.size(); ++i) compare(samples.reference(i), matrices[i], "threaded batch", i);
 
-        if (ImGui::Button("Toggle Fullscreen")) {
-            toggleFullscreen();
-        }
+    std::cout << "Matrix test: " << checked << " matrices, " << failures << " mismatches (" << VectorLanes::width
+        << " lanes)" << std::endl;
+    return failures == 0 ? 0 : 1;
+}
 
-        ImGui::End();
+// Reports matrices per second for the chained glm calls, the closed form one lane at
+// a time, the vectorized batch and the threaded batch
+void runMatrixBenchmark(size_t count) {
+    typedef std::chrono::steady_clock Clock;
+    TransformSamples samples(count, 1);
+    TransformBatch batch = samples.batch();
+    std::vector<glm::mat4> matrices(count);
+    double checksum = 0.0;
+
+    auto measure = [&](const char* label, const std::function<void()>& compose) {
+        compose();
+        int repeats = 0;
+        Clock::time_point start = Clock::now();
+        double seconds = 0.0;
+        do {
+            compose();
+            ++repeats;
+            seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        } while (seconds < 0.5);
+        checksum += matrices[count / 2][1][2];
+        std::cout << "  " << label << count * repeats / seconds / 1e6 << " M matrices/s" << std::endl;
+    };
+
+    std::cout << "Matrix benchmark: " << count << " matrices, " << VectorLanes::width << " lanes" << std::endl;
+    measure("glm chain     ", [&]() {
+        for (size_t i = 0; i < count; ++i) matrices[i] = samples.reference(i);
+    });
+    measure("closed form   ", [&]() {
+        for (size_t i = 0; i < count; ++i) composeLanes<ScalarLanes>(batch, i, matrices.data());
+    });
+    WorkStealingPool pool(std::max(1u, std::thread::hardware_concurrency()));
+    measure("vectorized    ", [&]() { composeModelMatrices(batch, matrices.data()); });
+    measure("threaded      ", [&]() { composeModelMatrices(batch, matrices.data(), &pool); });
+    std::cout << "  (checksum " << checksum << ")" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    // 3d --matrix-test checks the closed-form composer against glm; 3d --matrix-bench [count]
+    // times it. Neither needs a window.
+    if (argc > 1 && std::strcmp(argv[1], "--matrix-test") == 0) {
+        return runMatrixTest();
+    }
+    if (argc > 1 && std::strcmp(argv[1], "--matrix-bench") == 0) {
+        runMatrixBenchmark(argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 100000);
+        return 0;
     }
 
-    void render() {
-        glUseProgram(shaderProgram);
+    // 3d --mesh-bench file [threads] times the OBJ/PLY loader on one and on all threads
+    if (argc > 2 && std::strcmp(argv[1], "--mesh-bench") == 0) {
+        return runMeshBenchmark(argv[2], argc > 3 ? static_cast<unsigned>(std::strtoul(argv[3], nullptr, 10)) : 0);
+    }
 
-        // Create view matrix
-        glm::mat4 view = glm::lookAt(
-            cameraPos,
-            glm::vec3(0.0f, 0.0f, 0.0f),
-            glm::vec3(0.0f, 1.0f, 0.0f)
-        );
+    // 3d --headless ... renders scripted scenes offscreen and prints JSON timings
+    if (argc > 1 && std::strcmp(argv[1], "--headless") == 0) {
+        return runHeadless(argc, argv);
+    }
 
-        // Create transformation matrix
-        glm::mat4 model = glm::mat4(1.0f);
+    // 3d --scene-bench [instances] times the instanced scene in a hidden window
+    bool sceneBenchmark = argc > 1 && std::strcmp(argv[1], "--scene-bench") == 0;
+    size_t benchmarkInstances = sceneBenchmark && argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 100000;
 
-        // Apply transformations in order
-        // Translation
-        model = glm::translate(model, translation);
-
-        // Rotation
-        model = glm::rotate(model, glm::radians(rotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
-        model = glm::rotate(model, glm::radians(rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::rotate(model, glm::radians(rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
-
-        // Scale
-        model = glm::scale(model, scale);
-
-        // Shear
-        glm::mat4 shearMatrix(1.0f);
-        shearMatrix[0][1] = shear.y; // xy shear
-        shearMatrix[0][2] = shear.z; // xz shear
-        shearMatrix[1][0] = shear.x; // yx shear
-        shearMatrix[1][2] = shear.z; // yz shear
-        shearMatrix[2][0] = shear.x; // zx shear
-        shearMatrix[2][1] = shear.y; // zy shear
-        model = model * shearMatrix;
-
-        // Reflection
-        if (reflection[0]) model = glm::scale(model, glm::vec3(-1.0f, 1.0f, 1.0f));
-        if (reflection[1]) model = glm::scale(model, glm::vec3(1.0f, -1.0f, 1.0f));
-        if (reflection[2]) model = glm::scale(model, glm::vec3(1.0f, 1.0f, -1.0f));
+    // --geometry-report prints the geometry pool's per-mesh memory at startup;
+    // --profile starts with the frame profiler enabled; --model FILE loads an .obj or
+    // binary .ply file and opens it in transformation mode, reordered by optimizeMesh()
+    // unless --no-optimize is given; --optimize-overdraw adds the overdraw pass and
+    // --meshlets reports the meshlet split
+    bool geometryReport = false;
+    bool profileAtStartup = false;
+    bool optimizeModel = true, overdrawPass = false, reportMeshlets = false;
+    std::string modelPath;
 
-        // Set uniforms
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+    // --update-thread moves the intro and scene animation onto an UpdateThread ticking at
+    // --update-hz N (default 120); --frame-stats prints frame interval and input-to-present
+    // latency statistics at exit, to compare against the default single-threaded loop
+    bool useUpdateThread = false;
+    bool frameStats = false;
+    double updateRate = 120.0;
 
-        // Draw the shape
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, currentShape.indices.size(), GL_UNSIGNED_INT, 0);
+    // --capture DIR records every drawn frame through a FrameCapture as
+    // --capture-format ppm|png|raw files, or --capture-pipe CMD streams them to an encoder;
+    // --capture-queue N bounds the frames waiting for the writer (default 8). Add
+    // --continuous for a constant-rate recording of the transformation screen.
+    std::string captureDirectory, capturePipe, captureFormatName = "ppm";
+    size_t captureQueue = 8;
+
+    // Frames are drawn only when something changed or is animating. --fps N caps the
+    // frame rate (0 = vsync only), --continuous redraws every iteration as before.
+    FramePacer pacer;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--continuous") == 0) pacer.continuous = true;
+        else if (std::strcmp(argv[i], "--fps") == 0 && i + 1 < argc) pacer.maxFps = std::atof(argv[++i]);
+        else if (std::strcmp(argv[i], "--geometry-report") == 0) geometryReport = true;
+        else if (std::strcmp(argv[i], "--profile") == 0) profileAtStartup = true;
+        else if (std::strcmp(argv[i], "--update-thread") == 0) useUpdateThread = true;
+        else if (std::strcmp(argv[i], "--update-hz") == 0 && i + 1 < argc) updateRate = std::atof(argv[++i]);
+        else if (std::strcmp(argv[i], "--frame-stats") == 0) frameStats = true;
+        else if (std::strcmp(argv[i], "--model") == 0 && i + 1 < argc) modelPath = argv[++i];
+        else if (std::strcmp(argv[i], "--no-optimize") == 0) optimizeModel = false;
+        else if (std::strcmp(argv[i], "--optimize-overdraw") == 0) overdrawPass = true;
+        else if (std::strcmp(argv[i], "--meshlets") == 0) reportMeshlets = true;
+        else if (std::strcmp(argv[i], "--capture") == 0 && i + 1 < argc) captureDirectory = argv[++i];
+        else if (std::strcmp(argv[i], "--capture-format") == 0 && i + 1 < argc) captureFormatName = argv[++i];
+        else if (std::strcmp(argv[i], "--capture-pipe") == 0 && i + 1 < argc) capturePipe = argv[++i];
+        else if (std::strcmp(argv[i], "--capture-queue") == 0 && i + 1 < argc) {
+            captureQueue = std::strtoul(argv[++i], nullptr, 10);
+        }
+    }
+    FrameCapture::Format captureFormat = FrameCapture::PPM;
+    if (!FrameCapture::parseFormat(captureFormatName, captureFormat)) {
+        std::cerr << "Unknown capture format " << captureFormatName << std::endl;
+        return -1;
     }
 
-    void cleanup() {
-        glDeleteVertexArrays(1, &VAO);
-        glDeleteBuffers(1, &VBO);
-        glDeleteBuffers(1, &EBO);
-        glDeleteProgram(shaderProgram);
+    // Loading needs no context, so a bad file is reported before a window opens
+    Shape model;
+    if (!modelPath.empty()) {
+        MeshLoadStats stats;
+        std::string error;
+        if (!loadMesh(modelPath, model, stats, error)) {
+            std::cerr << "Could not load " << modelPath << ": " << error << std::endl;
+            return -1;
+        }
+        printMeshLoadStats(std::cout, modelPath, stats);
+        if (optimizeModel) {
+            MeshOptimizeStats optimizeStats;
+            std::vector<Meshlet> meshlets;
+            optimizeMesh(model, optimizeStats, reportMeshlets ? &meshlets : nullptr, overdrawPass);
+            printMeshOptimizeStats(std::cout, optimizeStats);
+        }
+        model.fitUnitCube();
+        if (!stats.colored) model.colorByPosition();
     }
-};
 
-int main() {
     // Initialize GLFW
     if (!glfwInit()) {
         std::cerr << "Failed to initialize GLFW" << std::endl;
@@ -484,6 +4766,9 @@ int main() {
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    if (sceneBenchmark) {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    }
 
     // Create window
     GLFWwindow* window = glfwCreateWindow(800, 600, "3D Shape Transformer", NULL, NULL);
@@ -495,6 +4780,8 @@ int main() {
 
     glfwMakeContextCurrent(window);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    installDirtyCallbacks(window, pacer);
+    glfwSwapInterval(1);
 
     // Initialize GLEW
     if (glewInit() != GLEW_OK) {
@@ -503,6 +4790,18 @@ int main() {
         return -1;
     }
 
+    if (sceneBenchmark) {
+        glEnable(GL_DEPTH_TEST);
+        ProgramCache programCache;
+        GeometryPool geometry;
+        runSceneBenchmark(programCache, geometry, benchmarkInstances);
+        geometry.report(std::cout);
+        geometry.cleanup();
+        programCache.cleanup();
+        glfwTerminate();
+        return 0;
+    }
+
     // Initialize ImGui
     IMGUI_CHECKVERSION();
     ImGui::CreateContext();
@@ -513,16 +4812,86 @@ int main() {
     // Enable depth testing
     glEnable(GL_DEPTH_TEST);
 
+    // Programs and geometry are shared by the selector, the renderer and the scene
+    ProgramCache programCache;
+    GeometryPool geometry;
+    FrameProfiler profiler;
+
     // Create shape selector for intro screen
-    ShapeSelector shapeSelector;
+    ShapeSelector shapeSelector(programCache, geometry);
     Renderer* renderer = nullptr;
+    InstancedScene* scene = nullptr;
     bool introScreen = true;
+    if (!model.vertices.empty()) {
+        renderer = new Renderer(window, programCache, geometry);
+        renderer->setMesh(geometry.add("model", model));
+        model = Shape(); // the pool's buffers hold the packed mesh from here on
+        introScreen = false;
+    }
+    if (geometryReport) {
+        geometry.report(std::cout);
+    }
+
+    // Scene mode settings
+    int sceneInstances = 100000;
+    bool drawPerObject = false;
+    float sceneAngle = 0.0f;
+    GeometryPool::FrameStats lastFrameStats;
+    profiler.enabled = profileAtStartup;
+
+    std::unique_ptr<UpdateThread> updateThread;
+    if (useUpdateThread) updateThread.reset(new UpdateThread(updateRate));
+
+    FrameCapture capture;
+    if (!captureDirectory.empty() || !capturePipe.empty()) {
+        std::string error;
+        if (!capture.start(captureDirectory, captureFormat, capturePipe, captureQueue, error)) {
+            std::cerr << "Capture: " << error << std::endl;
+        }
+    }
+
+    // Swap-to-swap intervals, and for each new input the time until the first frame
+    // built from it was swapped
+    FrameTimes frameIntervals, inputLatency;
+    double previousSwap = 0.0, measuredInput = 0.0;
 
     // Main loop
     while (!glfwWindowShouldClose(window)) {
+        // The intro and scene screens animate; the transformation screen only redraws
+        // when its sliders, camera or window change
+        bool animating = introScreen || scene != nullptr;
+        float deltaTime = pacer.waitForFrame(window, animating);
+        if (glfwWindowShouldClose(window)) break;
+        lastFrameStats = geometry.beginFrame();
+        profiler.beginFrame();
+
+        if (pacer.takeResized()) {
+            int width, height;
+            glfwGetFramebufferSize(window, &width, &height);
+            if (width > 0 && height > 0) shapeSelector.updateProjection(width, height);
+            if (renderer) renderer->updateProjection();
+        }
+
+        // Everything drawn this frame reflects the input polled above, unless it comes
+        // from an update thread snapshot made from an earlier request
+        double reflectedInput = pacer.lastInput();
+        const FrameSnapshot* snapshot = nullptr;
+        if (updateThread) {
+            UpdateThread::Request request;
+            request.mode = introScreen ? UpdateThread::INTRO : scene ? UpdateThread::SCENE : UpdateThread::IDLE;
+            request.sceneInstances = static_cast<size_t>(sceneInstances);
+            glfwGetFramebufferSize(window, &request.width, &request.height);
+            request.inputTime = reflectedInput;
+            updateThread->request(request);
+            snapshot = &updateThread->latest();
+        }
+
         // Clear buffers
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+        {
+            ProfileScope scope(profiler, "clear");
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+        }
 
         // Start ImGui frame
         ImGui_ImplOpenGL3_NewFrame();
@@ -531,38 +4900,152 @@ int main() {
 
         if (introScreen) {
             // Render shape selection screen
-            shapeSelector.render();
+            if (!snapshot) {
+                shapeSelector.update(deltaTime);
+            }
+            else if (snapshot->mode == UpdateThread::INTRO) {
+                shapeSelector.setRotation(snapshot->selectorAngle);
+                reflectedInput = snapshot->inputTime;
+            }
+            {
+                ProfileScope scope(profiler, "shapes");
+                shapeSelector.render();
+            }
+            {
+                ProfileScope scope(profiler, "ui", false);
+                shapeSelector.renderUI();
+            }
 
             // Check if a shape has been selected
             int selectedShape = shapeSelector.getSelectedShape();
-            if (selectedShape != -1) {
+            if (selectedShape == ShapeSelector::SCENE) {
+                // With an update thread the instances live there and the scene only draws
+                scene = new InstancedScene(programCache, geometry);
+                if (!updateThread) scene->populate(sceneInstances);
+                introScreen = false;
+            }
+            else if (selectedShape != -1) {
                 // Create renderer with selected shape
-                renderer = new Renderer(window);
+                renderer = new Renderer(window, programCache, geometry);
                 renderer->setShape(static_cast<Shape::Type>(selectedShape));
                 introScreen = false;
             }
         }
+        else if (scene) {
+            size_t instanceCount = scene->size();
+            if (!snapshot) {
+                // Slow orbit around the instance grid
+                int width, height;
+                glfwGetFramebufferSize(window, &width, &height);
+                sceneAngle += deltaTime * 0.2f;
+                glm::mat4 view, projection;
+                InstancedScene::orbitCamera(sceneAngle, scene->viewDistance(), static_cast<float>(width) / std::max(height, 1),
+                    view, projection);
+
+                ProfileScope scope(profiler, "scene");
+                scene->update(deltaTime);
+                if (drawPerObject) scene->renderPerObject(view, projection);
+                else scene->render(view, projection);
+            }
+            else if (snapshot->mode == UpdateThread::SCENE) {
+                instanceCount = snapshot->matrices[0].size() + snapshot->matrices[1].size();
+                reflectedInput = snapshot->inputTime;
+
+                ProfileScope scope(profiler, "scene");
+                if (drawPerObject) scene->drawPerObject(snapshot->view, snapshot->projection, snapshot->matrices);
+                else scene->draw(snapshot->view, snapshot->projection, snapshot->matrices);
+            }
+
+            ProfileScope scope(profiler, "ui", false);
+            ImGui::SetNextWindowPos(ImVec2(10, 10), ImGuiCond_FirstUseEver);
+            ImGui::Begin("Scene");
+            ImGui::Text("%zu instances, %.1f ms/frame", instanceCount, deltaTime * 1000.0f);
+            ImGui::Text("%.2f M instances/s", instanceCount / std::max(deltaTime, 1e-6f) / 1e6f);
+            ImGui::Text("%zu draws, %zu vertex array binds", lastFrameStats.draws, lastFrameStats.binds);
+            if (snapshot) ImGui::Text("Update thread tick %llu", static_cast<unsigned long long>(snapshot->tick));
+            if (ImGui::SliderInt("Instances", &sceneInstances, 1000, 250000) && !updateThread) {
+                scene->populate(sceneInstances);
+            }
+            ImGui::Checkbox("One draw per object", &drawPerObject);
+            ImGui::End();
+        }
         else {
             // Render transformation mode
-            renderer->render();
-            renderer->renderUI();
+            {
+                ProfileScope scope(profiler, "render");
+                renderer->render();
+            }
+            {
+                ProfileScope scope(profiler, "ui", false);
+                renderer->renderUI();
+            }
+
+            // A change made in this frame's UI shows up in the next one
+            if (renderer->takeDirty()) pacer.markDirty();
+        }
+
+        profiler.renderUI();
+        if (capture.isActive()) {
+            ImGui::Begin("Capture");
+            ImGui::Text("%zu frames, %zu queued", capture.frames(), capture.queued());
+            ImGui::Text("%.2f ms/frame overhead", capture.lastOverheadMs());
+            ImGui::End();
         }
 
         // Render ImGui
-        ImGui::Render();
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        {
+            ProfileScope scope(profiler, "imgui render");
+            ImGui::Render();
+            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        }
 
-        // Swap buffers and poll events
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        // The back buffer as it is about to be shown, UI included
+        if (capture.isActive()) {
+            ProfileScope scope(profiler, "capture", false);
+            int width, height;
+            glfwGetFramebufferSize(window, &width, &height);
+            capture.capture(width, height);
+        }
+
+        // Events are polled by the pacer before the next frame
+        {
+            ProfileScope scope(profiler, "swap", false);
+            glfwSwapBuffers(window);
+        }
+        profiler.endFrame();
+
+        if (frameStats) {
+            double now = glfwGetTime();
+            if (previousSwap > 0.0) frameIntervals.samples.push_back((now - previousSwap) * 1000.0);
+            previousSwap = now;
+            if (reflectedInput > measuredInput) {
+                inputLatency.samples.push_back((now - reflectedInput) * 1000.0);
+                measuredInput = reflectedInput;
+            }
+        }
+    }
+
+    if (frameStats) {
+        std::cout << (updateThread ? "Update thread at " + std::to_string(static_cast<int>(updateRate)) + " Hz" :
+            std::string("Single-threaded loop")) << std::endl;
+        frameIntervals.print(std::cout, "Frame interval");
+        inputLatency.print(std::cout, "Input latency");
+    }
+    updateThread.reset();
+    if (capture.isActive()) {
+        capture.finish();
+        capture.print(std::cout);
     }
 
     // Cleanup
-    if (renderer) {
-        renderer->cleanup();
-        delete renderer;
+    delete renderer;
+    if (scene) {
+        scene->cleanup();
+        delete scene;
     }
-    shapeSelector.cleanup();
+    profiler.cleanup();
+    geometry.cleanup();
+    programCache.cleanup();
 
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();